@@ -0,0 +1,478 @@
+/**
+ * @file   bench_ht530.c
+ * @brief   Multi-threaded throughput/latency benchmark for /dev/ht530
+ *
+ * Every thread opens its own fds and issues a get/put/delete mix against a key space drawn
+ * uniformly or from a Zipfian distribution, timing each call. Per-thread HDR-style (log-linear)
+ * histograms are merged at the end into throughput and p50/p99/p999 latency per operation.
+ *
+ *    ./bench -t 8 -f 2 -k 1000000 -d zipf -m 90:8:2 -D 10
+ *    ./bench -o json ...      one JSON object per run, for scripts
+ *    ./bench -V ...           gets through the mmap()ed view, read() only when it can't tell
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "ht530_ioctl.h"   /// struct ht, ht530_view_get
+#ifdef HT530_MOCK
+#include "ht530_mock.h"   /// run against the in-process tables of libht530.a instead of the module
+#endif
+
+#define DEVICE_PATH "/dev/ht530"
+
+/*
+ * Log-linear histogram: values below 2^sub_bits ns are recorded exactly, above that each power of
+ * two is split into 2^(sub_bits-1) equal slots, i.e. a relative error under 1/2^(sub_bits-1) (~1.6%).
+ */
+#define sub_bits   7
+#define max_shift  40   /// values are clamped to 2^(max_shift+sub_bits-1) ns, about 2.4 hours
+#define hist_slots (((max_shift + 1) << (sub_bits - 1)) + (1 << (sub_bits - 1)))
+
+enum { OP_GET, OP_PUT, OP_DEL, NR_OPS };
+static const char *op_names[NR_OPS] = { "get", "put", "del" };
+
+struct hist {
+   uint64_t count;
+   uint64_t max;
+   uint64_t slot[hist_slots];
+};
+
+static unsigned int hist_index(uint64_t v){
+   unsigned int k, shift;
+
+   if (v < (1ULL << sub_bits))
+      return v;
+   k = 63 - __builtin_clzll(v);   // floor(log2(v)) >= sub_bits
+   shift = k - (sub_bits - 1);
+   if (shift > max_shift)
+      return hist_slots - 1;
+   return (shift << (sub_bits - 1)) + (unsigned int)(v >> shift);
+}
+
+static uint64_t hist_value(unsigned int idx){   /// midpoint of the values recorded in slot idx
+   unsigned int shift;
+   uint64_t m;
+
+   if (idx < (1U << sub_bits))
+      return idx;
+   shift = (idx >> (sub_bits - 1)) - 1;
+   m = idx - (shift << (sub_bits - 1));
+   return (m << shift) + ((1ULL << shift) >> 1);
+}
+
+static void hist_record(struct hist *h, uint64_t v){
+   h->slot[hist_index(v)]++;
+   h->count++;
+   if (v > h->max)
+      h->max = v;
+}
+
+static void hist_merge(struct hist *dst, const struct hist *src){
+   unsigned int i;
+
+   for (i = 0; i < hist_slots; i++)
+      dst->slot[i] += src->slot[i];
+   dst->count += src->count;
+   if (src->max > dst->max)
+      dst->max = src->max;
+}
+
+static uint64_t hist_percentile(const struct hist *h, double p){
+   uint64_t want, seen = 0;
+   unsigned int i;
+
+   if (!h->count)
+      return 0;
+   want = (uint64_t)ceil(p / 100.0 * h->count);
+   if (want == 0)
+      want = 1;
+   for (i = 0; i < hist_slots; i++) {
+      seen += h->slot[i];
+      if (seen >= want)
+         return hist_value(i) < h->max ? hist_value(i) : h->max;
+   }
+   return h->max;
+}
+
+/* xorshift64* -- per thread, no shared state */
+static inline uint64_t rng_next(uint64_t *s){
+   uint64_t x = *s;
+   x ^= x >> 12;
+   x ^= x << 25;
+   x ^= x >> 27;
+   *s = x;
+   return x * 0x2545F4914F6CDD1DULL;
+}
+
+static inline double rng_unit(uint64_t *s){   /// uniform in [0, 1)
+   return (rng_next(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * Zipfian ranks in [0, n) with exponent theta, the generator from Gray et al., "Quickly Generating
+ * Billion-Record Synthetic Databases" (as used by YCSB). zeta(n) is computed once, O(n).
+ */
+struct zipf {
+   uint64_t n;
+   double theta, alpha, zetan, eta;
+};
+
+static void zipf_init(struct zipf *z, uint64_t n, double theta){
+   double zeta2 = 1.0 + pow(0.5, theta);
+   uint64_t i;
+
+   z->n = n;
+   z->theta = theta;
+   z->zetan = 0;
+   for (i = 1; i <= n; i++)
+      z->zetan += 1.0 / pow((double)i, theta);
+   z->alpha = 1.0 / (1.0 - theta);
+   z->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / z->zetan);
+}
+
+static uint64_t zipf_next(const struct zipf *z, uint64_t *s){
+   double u = rng_unit(s);
+   double uz = u * z->zetan;
+   uint64_t r;
+
+   if (uz < 1.0)
+      return 0;
+   if (uz < 1.0 + pow(0.5, z->theta))
+      return 1;
+   r = (uint64_t)(z->n * pow(z->eta * u - z->eta + 1.0, z->alpha));
+   return r < z->n ? r : z->n - 1;
+}
+
+struct config {
+   const char *path;
+   unsigned int threads;
+   unsigned int fds;          // per thread
+   uint64_t keys;             // key space [0, keys)
+   int zipfian;
+   double theta;
+   unsigned int mix[NR_OPS];  // relative weights of get/put/del
+   unsigned int duration;     // seconds
+   int prefill;
+   int bulk;                  // prefill with one HT530_BULK_LOAD
+   const struct ht530_view_hdr *view;   // -V: gets look here first
+   int json;
+   uint64_t seed;
+};
+
+struct worker {
+   pthread_t tid;
+   unsigned int id;
+   const struct config *cfg;
+   const struct zipf *zipf;
+   int *fds;
+   uint64_t hits, misses, errors;
+   uint64_t fallbacks;        // -V gets the view sent to read()
+   struct hist hist[NR_OPS];
+};
+
+static atomic_int go, stop;
+
+static inline uint64_t now_ns(void){
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *worker_run(void *arg){
+   struct worker *w = arg;
+   const struct config *c = w->cfg;
+   unsigned int total = c->mix[OP_GET] + c->mix[OP_PUT] + c->mix[OP_DEL];
+   uint64_t s = c->seed ^ (0x9E3779B97F4A7C15ULL * (w->id + 1));
+   unsigned int f = 0, op, pick;
+   struct ht kv;
+   uint64_t t0, t1;
+   ssize_t ret;
+
+   while (!atomic_load_explicit(&go, memory_order_acquire))
+      ;
+   while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+      pick = rng_next(&s) % total;
+      op = pick < c->mix[OP_GET] ? OP_GET : pick < c->mix[OP_GET] + c->mix[OP_PUT] ? OP_PUT : OP_DEL;
+      kv.key = (int)(c->zipfian ? zipf_next(w->zipf, &s) : rng_next(&s) % c->keys);
+      kv.data = op == OP_PUT ? (int)(rng_next(&s) | 1) : 0;   // data 0 means delete
+      f = f + 1 == c->fds ? 0 : f + 1;
+
+      t0 = now_ns();
+      if (op == OP_GET && c->view) {
+         ret = ht530_view_get(c->view, kv.key, &kv.data);
+         if (ret < 0) {
+            w->fallbacks++;
+            ret = read(w->fds[f], &kv, sizeof(kv));
+         } else {
+            ret = ret ? 0 : EINVAL;   // as read() reports it
+         }
+      } else if (op == OP_GET)
+         ret = read(w->fds[f], &kv, sizeof(kv));
+      else
+         ret = write(w->fds[f], &kv, sizeof(kv));
+      t1 = now_ns();
+
+      hist_record(&w->hist[op], t1 - t0);
+      if (ret < 0)
+         w->errors++;
+      else if (op == OP_GET && ret == EINVAL)   // the module returns positive EINVAL on a miss
+         w->misses++;
+      else if (op == OP_GET)
+         w->hits++;
+   }
+   return NULL;
+}
+
+static int prefill(const struct config *c){   /// put every key once, one thread
+   struct ht530_bulk_load bl = { 0 };
+   struct ht kv, *pairs;
+   uint64_t k, t0 = now_ns();
+   double secs;
+   int fd = open(c->path, O_RDWR), ret = 0;
+
+   if (fd < 0)
+      return -1;
+   if (c->bulk) {
+      pairs = malloc(c->keys * sizeof(*pairs));
+      if (!pairs) {
+         close(fd);
+         return -1;
+      }
+      for (k = 0; k < c->keys; k++) {
+         pairs[k].key = (int)k;
+         pairs[k].data = (int)k | 1;
+      }
+      t0 = now_ns();
+      bl.buf = (uintptr_t)pairs;
+      bl.count = c->keys;
+      ret = ioctl(fd, HT530_BULK_LOAD, &bl);
+      free(pairs);
+   }
+   for (k = 0; k < c->keys && !c->bulk && !ret; k++) {
+      kv.key = (int)k;
+      kv.data = (int)k | 1;
+      ret = write(fd, &kv, sizeof(kv)) < 0 ? -1 : 0;
+   }
+   secs = (now_ns() - t0) / 1e9;
+   close(fd);
+   if (!ret && !c->json)
+      printf("prefill: %llu keys in %.3f s (%.0f keys/s)\n", (unsigned long long)c->keys, secs, c->keys / secs);
+   return ret;
+}
+
+static const struct ht530_view_hdr *view_map(const char *path){   /// map the table's view, NULL if it has none
+   const struct ht530_view_hdr *v;
+   uint64_t size;
+   int fd = open(path, O_RDONLY);
+
+   if (fd < 0)
+      return NULL;
+   v = mmap(NULL, HT530_VIEW_HDR_SIZE, PROT_READ, MAP_SHARED, fd, HT530_VIEW_OFFSET);   // the header has the size
+   if (v == MAP_FAILED || v->magic != HT530_VIEW_MAGIC) {
+      if (v != MAP_FAILED)
+         munmap((void *)v, HT530_VIEW_HDR_SIZE);
+      close(fd);
+      return NULL;
+   }
+   size = v->map_size;
+   munmap((void *)v, HT530_VIEW_HDR_SIZE);
+   v = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, HT530_VIEW_OFFSET);
+   close(fd);   // the mapping keeps the table
+   return v == MAP_FAILED ? NULL : v;
+}
+
+static void usage(const char *prog){
+   fprintf(stderr,
+      "usage: %s [options]\n"
+      "  -p PATH     device (default " DEVICE_PATH ")\n"
+      "  -t N        threads (default 4)\n"
+      "  -f N        fds per thread, used round-robin (default 1)\n"
+      "  -k N        key space size (default 100000)\n"
+      "  -d DIST     uniform | zipf (default uniform)\n"
+      "  -z THETA    Zipf exponent, 0 < THETA < 1 (default 0.99)\n"
+      "  -m G:P:D    get:put:delete weights (default 90:9:1)\n"
+      "  -D SECONDS  duration (default 5)\n"
+      "  -P          put every key once before measuring\n"
+      "  -L          with -P, load the keys with one HT530_BULK_LOAD instead of a write() each\n"
+      "  -V          look keys up in the table's mmap()ed view (module loaded with view_bits), read() only when it can't tell\n"
+      "  -s SEED     random seed (default 1)\n"
+      "  -o FORMAT   text | json (default text)\n", prog);
+}
+
+static void report(const struct config *c, struct worker *ws, double secs){
+   struct hist *all = calloc(NR_OPS + 1, sizeof(*all));
+   uint64_t hits = 0, misses = 0, errors = 0, fallbacks = 0;
+   unsigned int i, op;
+
+   if (!all) {
+      perror("calloc");
+      return;
+   }
+   for (i = 0; i < c->threads; i++) {
+      for (op = 0; op < NR_OPS; op++) {
+         hist_merge(&all[op], &ws[i].hist[op]);
+         hist_merge(&all[NR_OPS], &ws[i].hist[op]);
+      }
+      hits += ws[i].hits;
+      misses += ws[i].misses;
+      errors += ws[i].errors;
+      fallbacks += ws[i].fallbacks;
+   }
+
+   if (c->json) {
+      printf("{\"threads\":%u,\"fds_per_thread\":%u,\"keys\":%llu,\"dist\":\"%s\",\"theta\":%.3f,"
+             "\"mix\":[%u,%u,%u],\"seconds\":%.3f,\"ops\":%llu,\"ops_per_sec\":%.0f,"
+             "\"hits\":%llu,\"misses\":%llu,\"errors\":%llu",
+             c->threads, c->fds, (unsigned long long)c->keys, c->zipfian ? "zipf" : "uniform", c->theta,
+             c->mix[OP_GET], c->mix[OP_PUT], c->mix[OP_DEL], secs,
+             (unsigned long long)all[NR_OPS].count, all[NR_OPS].count / secs,
+             (unsigned long long)hits, (unsigned long long)misses, (unsigned long long)errors);
+      for (op = 0; op <= NR_OPS; op++) {
+         const struct hist *h = &all[op];
+         printf(",\"%s\":{\"ops\":%llu,\"ops_per_sec\":%.0f,\"p50_ns\":%llu,\"p99_ns\":%llu,"
+                "\"p999_ns\":%llu,\"max_ns\":%llu}",
+                op == NR_OPS ? "all" : op_names[op], (unsigned long long)h->count, h->count / secs,
+                (unsigned long long)hist_percentile(h, 50), (unsigned long long)hist_percentile(h, 99),
+                (unsigned long long)hist_percentile(h, 99.9), (unsigned long long)h->max);
+      }
+      if (c->view)
+         printf(",\"view_fallbacks\":%llu", (unsigned long long)fallbacks);
+      printf("}\n");
+   } else {
+      printf("%u threads x %u fds, %llu keys %s, mix %u:%u:%u, %.2f s\n",
+             c->threads, c->fds, (unsigned long long)c->keys, c->zipfian ? "zipf" : "uniform",
+             c->mix[OP_GET], c->mix[OP_PUT], c->mix[OP_DEL], secs);
+      printf("%-4s %12s %12s %10s %10s %10s %10s\n", "op", "ops", "ops/s", "p50 ns", "p99 ns", "p999 ns", "max ns");
+      for (op = 0; op <= NR_OPS; op++) {
+         const struct hist *h = &all[op];
+         printf("%-4s %12llu %12.0f %10llu %10llu %10llu %10llu\n",
+                op == NR_OPS ? "all" : op_names[op], (unsigned long long)h->count, h->count / secs,
+                (unsigned long long)hist_percentile(h, 50), (unsigned long long)hist_percentile(h, 99),
+                (unsigned long long)hist_percentile(h, 99.9), (unsigned long long)h->max);
+      }
+      printf("gets: %llu hits, %llu misses; %llu errors\n",
+             (unsigned long long)hits, (unsigned long long)misses, (unsigned long long)errors);
+      if (c->view)
+         printf("view: %llu gets fell back to read()\n", (unsigned long long)fallbacks);
+   }
+   free(all);
+}
+
+int main(int argc, char **argv){
+   struct config c = {
+      .path = DEVICE_PATH, .threads = 4, .fds = 1, .keys = 100000, .theta = 0.99,
+      .mix = { 90, 9, 1 }, .duration = 5, .seed = 1,
+   };
+   struct zipf z;
+   struct worker *ws;
+   uint64_t t0, t1;
+   unsigned int i, j;
+   int opt, ret = 0, view = 0;
+
+   while ((opt = getopt(argc, argv, "p:t:f:k:d:z:m:D:PLVs:o:h")) != -1) {
+      switch (opt) {
+      case 'p': c.path = optarg; break;
+      case 't': c.threads = strtoul(optarg, NULL, 0); break;
+      case 'f': c.fds = strtoul(optarg, NULL, 0); break;
+      case 'k': c.keys = strtoull(optarg, NULL, 0); break;
+      case 'd':
+         if (!strcmp(optarg, "zipf"))
+            c.zipfian = 1;
+         else if (strcmp(optarg, "uniform")) {
+            usage(argv[0]);
+            return 1;
+         }
+         break;
+      case 'z': c.theta = strtod(optarg, NULL); break;
+      case 'm':
+         if (sscanf(optarg, "%u:%u:%u", &c.mix[OP_GET], &c.mix[OP_PUT], &c.mix[OP_DEL]) != 3) {
+            usage(argv[0]);
+            return 1;
+         }
+         break;
+      case 'D': c.duration = strtoul(optarg, NULL, 0); break;
+      case 'P': c.prefill = 1; break;
+      case 'L': c.bulk = 1; break;
+      case 'V': view = 1; break;
+      case 's': c.seed = strtoull(optarg, NULL, 0); break;
+      case 'o': c.json = !strcmp(optarg, "json"); break;
+      default:
+         usage(argv[0]);
+         return opt == 'h' ? 0 : 1;
+      }
+   }
+   if (!c.threads || !c.fds || !c.keys || c.keys > (1ULL << 31) || !c.duration ||
+       !(c.mix[OP_GET] + c.mix[OP_PUT] + c.mix[OP_DEL]) || (c.zipfian && (c.theta <= 0 || c.theta >= 1))) {
+      usage(argv[0]);
+      return 1;
+   }
+   if (c.zipfian)
+      zipf_init(&z, c.keys, c.theta);
+   if (c.prefill && prefill(&c)) {
+      perror("prefill");
+      return 1;
+   }
+   if (view && !(c.view = view_map(c.path))) {
+      perror("view");
+      return 1;
+   }
+
+   ws = calloc(c.threads, sizeof(*ws));
+   if (!ws) {
+      perror("calloc");
+      return 1;
+   }
+   for (i = 0; i < c.threads; i++) {
+      ws[i].id = i;
+      ws[i].cfg = &c;
+      ws[i].zipf = &z;
+      ws[i].fds = calloc(c.fds, sizeof(int));
+      if (!ws[i].fds) {
+         perror("calloc");
+         return 1;
+      }
+      for (j = 0; j < c.fds; j++) {
+         ws[i].fds[j] = open(c.path, O_RDWR);
+         if (ws[i].fds[j] < 0) {
+            perror("Failed to open the device");
+            return errno;
+         }
+      }
+      if (pthread_create(&ws[i].tid, NULL, worker_run, &ws[i])) {
+         perror("pthread_create");
+         return 1;
+      }
+   }
+
+   t0 = now_ns();
+   atomic_store_explicit(&go, 1, memory_order_release);
+   sleep(c.duration);
+   atomic_store_explicit(&stop, 1, memory_order_relaxed);
+   for (i = 0; i < c.threads; i++)
+      pthread_join(ws[i].tid, NULL);
+   t1 = now_ns();
+
+   report(&c, ws, (t1 - t0) / 1e9);
+
+   for (i = 0; i < c.threads; i++) {
+      for (j = 0; j < c.fds; j++)
+         close(ws[i].fds[j]);
+      free(ws[i].fds);
+      ret |= ws[i].errors != 0;
+   }
+   free(ws);
+   return ret;
+}
@@ -0,0 +1,3357 @@
+/**
+ * @file   ht530_core.c
+ * @author Aditya  Jha
+ * @date   5 Dec 2020
+ * @version 0
+ * @brief   The hash table itself, behind the ht530 device file (see ht530_dev.c)
+ */
+
+#ifdef __KERNEL__
+#include <linux/module.h>         // Core header for loading LKMs into the kernel
+#include <linux/uaccess.h>          // Required for the copy to user function
+#include <linux/log2.h>             /// order_base_2, roundup_pow_of_two
+#include <linux/math64.h>           /// div_u64, div64_u64
+#include <linux/atomic.h>           /// eviction hand
+#include <linux/slab.h>             /// ht_entry kmem_cache
+#include <linux/mm.h>               /// kvmalloc for bucket arrays
+#include <linux/sched.h>            /// cond_resched
+#include <linux/moduleparam.h>      /// debug parameter with a set hook
+#include <linux/random.h>           /// hash keys
+#include <linux/string.h>           /// memcmp/memcpy of key and value bytes
+#include <linux/bitops.h>           /// __ffs64 over tag match masks
+#include <linux/crc32.h>            /// snapshot checksum
+#include <linux/file.h>             /// fdget for bulk loads from a file
+#include <linux/fs.h>               /// kernel_read
+#include <linux/prefetch.h>         /// bulk loads run ahead of themselves
+#include <linux/shrinker.h>         /// cache tables give entries back under memory pressure
+#include <linux/sched/mm.h>         /// memalloc_use_memcg in the resize worker
+#endif
+
+#include "ht530_core.h"
+
+#ifdef __KERNEL__
+#define CREATE_TRACE_POINTS
+#include "ht530_trace.h"            /// ht530:* tracepoints, see events/ht530 in tracefs
+#endif
+
+#define  bits  8                 /// 2^8 = 256 buckets in the hash table when it is created (see init_bits)
+#define  lock_bits  5            /// 2^5 = 32 lock stripes per possible CPU, capped at the bucket count
+#define  stash_max  256          /// upper bound on the per-CPU entry stash (see stash_size)
+#define  stash_step  16          /// entries per bulk allocation when refilling it (on the stack)
+#define  batch_chunk  16         /// batch ops copied in from userspace per round trip (on the stack)
+
+DEFINE_STATIC_KEY_FALSE(ht530_debug_key);
+static bool debug;
+
+static int ht530_debug_set(const char *val, const struct kernel_param *kp){
+   int ret = param_set_bool(val, kp);
+
+   if (ret)
+      return ret;
+   if (debug)
+      static_branch_enable(&ht530_debug_key);
+   else
+      static_branch_disable(&ht530_debug_key);
+   return 0;
+}
+
+static const struct kernel_param_ops ht530_debug_ops = {
+   .set = ht530_debug_set,
+   .get = param_get_bool,
+};
+module_param_cb(debug, &ht530_debug_ops, &debug, 0644);
+MODULE_PARM_DESC(debug, "Log every operation at KERN_DEBUG (default off; prefer the ht530 tracepoints)");
+
+DEFINE_STATIC_KEY_FALSE(ht530_prof_key);
+static bool profile;
+
+static int ht530_profile_set(const char *val, const struct kernel_param *kp){
+   int ret = param_set_bool(val, kp);
+
+   if (ret)
+      return ret;
+   if (profile)
+      static_branch_enable(&ht530_prof_key);
+   else
+      static_branch_disable(&ht530_prof_key);
+   return 0;
+}
+
+static const struct kernel_param_ops ht530_profile_ops = {
+   .set = ht530_profile_set,
+   .get = param_get_bool,
+};
+module_param_cb(profile, &ht530_profile_ops, &profile, 0644);
+MODULE_PARM_DESC(profile, "time operations into latency histograms and sample hot keys, see debugfs (default off)");
+unsigned int hot_sample = 64;
+module_param(hot_sample, uint, 0444);
+MODULE_PARM_DESC(hot_sample, "with profile on, feed 1 in this many operations to the hot-key sketch, rounded to a power of two (default 64)");
+
+unsigned int init_bits = bits;
+module_param(init_bits, uint, 0444);
+MODULE_PARM_DESC(init_bits, "log2 of the initial (and minimum) bucket count of new tables (default 8)");
+unsigned int max_bits = 24;
+module_param(max_bits, uint, 0444);
+MODULE_PARM_DESC(max_bits, "log2 of the largest bucket count new tables grow to (default 24)");
+static unsigned int max_load = 100;
+module_param(max_load, uint, 0644);
+MODULE_PARM_DESC(max_load, "grow when entries exceed this percentage of the bucket count (default 100)");
+static unsigned int min_load = 25;
+module_param(min_load, uint, 0644);
+MODULE_PARM_DESC(min_load, "shrink when entries fall below this percentage of the bucket count (default 25, 0 = never)");
+static unsigned long max_entries;
+module_param(max_entries, ulong, 0644);
+MODULE_PARM_DESC(max_entries, "entry budget of new tables, evicting beyond it (default 0 = unlimited)");
+static unsigned long max_bytes;
+module_param(max_bytes, ulong, 0644);
+MODULE_PARM_DESC(max_bytes, "memory budget of new tables in bytes of entries, evicting beyond it (default 0 = unlimited)");
+static unsigned int default_ttl_ms;
+module_param(default_ttl_ms, uint, 0644);
+MODULE_PARM_DESC(default_ttl_ms, "TTL of entries put without one in new tables, ms (default 0 = none)");
+static char *backend = "chain";
+module_param(backend, charp, 0444);
+MODULE_PARM_DESC(backend, "table implementation: chain (hlist buckets, the default) or open (int-only open addressing in cache-line buckets)");
+static bool ht530_open_backend;             /// backend=open
+static unsigned int reap_ms = 1000;
+module_param(reap_ms, uint, 0644);
+MODULE_PARM_DESC(reap_ms, "interval of the expired-entry reaper, ms (default 1000, 0 = lazy expiry only)");
+static unsigned int chain_max = 16;
+module_param(chain_max, uint, 0644);
+MODULE_PARM_DESC(chain_max, "rehash new tables under a new hash key when a chain gets this much longer than average (default 16, 0 = never)");
+static unsigned int reclaim_idle_ms = 60000;
+module_param(reclaim_idle_ms, uint, 0644);
+MODULE_PARM_DESC(reclaim_idle_ms, "memory reclaim empties cache tables idle this long, ms (default 60000, 0 = never)");
+static unsigned int bloom_bits;
+module_param(bloom_bits, uint, 0644);
+MODULE_PARM_DESC(bloom_bits, "log2 of the counting Bloom filter of new chained tables, one byte per counter, 10 to 30 (default 0 = none)");
+static unsigned int view_bits;
+module_param(view_bits, uint, 0644);
+MODULE_PARM_DESC(view_bits, "log2 of the lines of the read-only mmap view of new tables, 7 int pairs per 64-byte line, 4 to 24 (default 0 = none)");
+
+
+static inline spinlock_t *ht530_bucket_lock(const struct ht530_bucket_table *tbl, unsigned int bkt){   /// stripe guarding bucket bkt
+   return &tbl->locks[bkt & tbl->lock_mask].lock;
+}
+
+/// Take a bucket lock stripe, counting the acquisition as contended if someone else holds it.
+/// Returns the nanoseconds (at least 1) it waited while profiling is on, else 0.
+static inline u64 ht530_lock_stripe(struct ht530_table *t, spinlock_t *lock, int subclass){
+   u64 start;
+
+   if (likely(spin_trylock(lock)))
+      return 0;
+   ht530_stat_inc(t, contended);
+   start = ht530_lat_start();
+   spin_lock_nested(lock, subclass);
+   return start ? max_t(u64, ktime_get_ns() - start, 1) : 0;
+}
+
+static inline unsigned int ht530_lat_slot(u64 ns){
+   return ns ? min_t(unsigned int, ilog2(ns), lat_slots - 1) : 0;
+}
+
+/// Account a profiled operation that began at start (ht530_lat_start) and waited wait ns for locks.
+void ht530_lat_end(struct ht530_table *t, unsigned int op, u64 start, u64 wait){
+   u64 total = ktime_get_ns() - start;
+
+   wait = min(wait, total);
+   this_cpu_inc(t->lat->wait[op][ht530_lat_slot(wait)]);
+   this_cpu_inc(t->lat->work[op][ht530_lat_slot(total - wait)]);
+}
+
+/*
+ * Count key into sketch which. Every row's counter for the key goes up and the key's estimate is the
+ * smallest of them, which can only overcount. The top list keeps the keys with the largest estimates
+ * seen; once the sketch has taken 2^16 samples every count is halved, so keys that cooled off make
+ * room for the ones hot now.
+ */
+#define hot_decay  65536
+
+static void ht530_hot_note(struct ht530_table *t, unsigned int which, const void *key, unsigned int klen){
+   struct ht530_hot *h = &t->hot[which];
+   struct ht530_hot_key *k, *coldest;
+   unsigned int d, i, kept = min_t(unsigned int, klen, hot_key_max);
+   u32 est = U32_MAX;
+   u64 m;
+
+   if (!spin_trylock(&h->lock))
+      return;   // another CPU is sampling, this one can go
+   m = (u64)ht530_hash(&h->hkey, key, klen) * 0x9e3779b97f4a7c15ULL;   // 9 bits of column per row
+   for (d = 0; d < hot_depth; d++)
+      est = min(est, ++h->cm[d][(m >> (9 * d)) % hot_width]);
+   coldest = &h->top[0];
+   for (i = 0; i < hot_top; i++) {
+      k = &h->top[i];
+      if (k->count && k->klen == klen && !memcmp(k->key, key, kept))
+         break;
+      if (k->count < coldest->count)
+         coldest = k;
+   }
+   if (i < hot_top) {
+      k->count = est;
+   } else if (est > coldest->count) {
+      coldest->count = est;
+      coldest->klen = klen;
+      memcpy(coldest->key, key, kept);
+   }
+   if (++h->samples >= hot_decay) {
+      for (d = 0; d < hot_depth; d++)
+         for (i = 0; i < hot_width; i++)
+            h->cm[d][i] /= 2;
+      for (i = 0; i < hot_top; i++)
+         h->top[i].count /= 2;
+      h->samples = 0;
+   }
+   spin_unlock(&h->lock);
+}
+
+static inline void ht530_hot_sample(struct ht530_table *t, const void *key, unsigned int klen){   /// a profiled get/put/delete of key
+   if (!(this_cpu_inc_return(t->lat->sample) & (READ_ONCE(hot_sample) - 1)))
+      ht530_hot_note(t, hot_ops, key, klen);
+}
+
+static struct ht_entry *ht530_find(struct hlist_head *head, unsigned int gen, u32 hash,
+                                   const void *key, unsigned int klen){   /// entry with key in one chain, or NULL
+   struct ht_entry *e;
+   struct hlist_node *n;
+   ht530_for_each_entry(e, n, head, gen){
+      if(e->hash[gen] == hash && e->klen == klen && !memcmp(e->key, key, klen))
+         return e;
+   }
+   return NULL;
+}
+
+static inline bool ht530_val_inline(const struct ht_entry *e){   /// value lives in the entry itself
+   return e->val == e->key + ALIGN(e->klen, 8);
+}
+
+static inline bool ht530_entry_is_int(const struct ht_entry *e){   /// visible through the int interfaces
+   return e->klen == sizeof(int) && e->vlen == sizeof(int);
+}
+
+static inline int ht530_entry_int_key(const struct ht_entry *e){
+   return *(const int *)e->key;
+}
+
+static inline int ht530_entry_int_data(const struct ht_entry *e){
+   return READ_ONCE(*(const int *)e->val);
+}
+
+static void ht530_entry_read_val(const struct ht_entry *e, void *buf, u32 len){   /// copy len <= vlen value bytes
+   u32 v32;
+   u64 v64;
+
+   // 4- and 8-byte values are the only ones updated in place, load them in one go
+   if (e->vlen == sizeof(v32)) {
+      v32 = READ_ONCE(*(const u32 *)e->val);
+      memcpy(buf, &v32, len);
+   } else if (e->vlen == sizeof(v64)) {
+      v64 = READ_ONCE(*(const u64 *)e->val);
+      memcpy(buf, &v64, len);
+   } else {
+      memcpy(buf, e->val, len);
+   }
+}
+
+/*
+ * Ordered tables also keep every entry in a red-black tree by key, for range and neighbour scans
+ * (point lookups still go through the hash). The tree node sits in the entry after the inline value
+ * (after the key if the value is out of line), and the tree is guarded by the table's index_lock,
+ * taken inside the bucket locks. 4-byte keys sort first, as ints, so the int interfaces see keys in
+ * numeric order; longer and shorter keys follow in bytewise order, a prefix before its extensions.
+ */
+struct ht530_onode {
+   struct rb_node rb;
+   struct ht_entry *e;
+};
+
+static inline struct ht530_onode *ht530_entry_onode(struct ht_entry *e){   /// index node of an entry of an ordered table
+   size_t off = ALIGN(e->klen, 8);
+
+   if (ht530_val_inline(e))
+      off += ALIGN(e->vlen, 8);
+   return (struct ht530_onode *)(e->key + off);
+}
+
+static int ht530_key_cmp(const void *a, unsigned int alen, const void *b, unsigned int blen){   /// index order
+   int x, y, r;
+
+   if (alen == sizeof(int) && blen == sizeof(int)) {
+      memcpy(&x, a, sizeof(x));
+      memcpy(&y, b, sizeof(y));
+      return (x > y) - (x < y);
+   }
+   if ((alen == sizeof(int)) != (blen == sizeof(int)))
+      return alen == sizeof(int) ? -1 : 1;
+   r = memcmp(a, b, min(alen, blen));
+   return r ? r : (alen > blen) - (alen < blen);
+}
+
+static inline bool ht530_expired(const struct ht_entry *e){   /// past its TTL; an expired entry is absent to every lookup
+   unsigned long x = READ_ONCE(e->expires);
+
+   return x && time_after_eq(jiffies, x);
+}
+
+static unsigned long ht530_expiry(u32 ttl_ms){   /// ht_entry::expires for a TTL, 0 = none
+   unsigned long x;
+
+   if (!ttl_ms)
+      return 0;
+   x = jiffies + msecs_to_jiffies(ttl_ms);
+   return x ? x : 1;   // 0 means "never"
+}
+
+static struct ht530_lock *ht530_locks_alloc(unsigned int new_bits, unsigned int *lock_mask){   /// lock stripes for 2^new_bits buckets
+   struct ht530_lock *locks;
+   unsigned int i, nlocks;
+
+   // enough stripes that CPUs rarely collide, never more than there are buckets
+   nlocks = min_t(unsigned int, 1U << new_bits, roundup_pow_of_two(num_possible_cpus()) << lock_bits);
+   locks = kvmalloc_array(nlocks, sizeof(*locks), GFP_KERNEL_ACCOUNT);
+   if (!locks)
+      return NULL;
+   for (i = 0; i < nlocks; i++)
+      spin_lock_init(&locks[i].lock);
+   *lock_mask = nlocks - 1;
+   return locks;
+}
+
+static struct ht530_bucket_table *ht530_bucket_table_alloc(unsigned int new_bits, unsigned int gen){
+   struct ht530_bucket_table *tbl;
+
+   tbl = kvzalloc(struct_size(tbl, buckets, 1UL << new_bits), GFP_KERNEL_ACCOUNT);
+   if (!tbl)
+      return NULL;
+   tbl->locks = ht530_locks_alloc(new_bits, &tbl->lock_mask);
+   if (!tbl->locks) {
+      kvfree(tbl);
+      return NULL;
+   }
+   tbl->nbits = new_bits;
+   tbl->gen = gen;
+   get_random_bytes(&tbl->key, sizeof(tbl->key));   // a resize that keeps the old key overwrites it
+   return tbl;   // buckets are zeroed, i.e. empty hlist heads
+}
+
+static void ht530_bucket_table_free(struct ht530_bucket_table *tbl){
+   kvfree(tbl->locks);
+   kvfree(tbl);
+}
+
+/*
+ * Entries come from a set of size-classed slab caches, picked by header + key + inline value. Items
+ * too big for the largest class keep only header and key in a class and get their value from
+ * kvmalloc. Optionally each CPU also keeps a small stash of free entries of the smallest class
+ * (which is where int entries live): inserts pop from it and RCU frees push back into it, so a table
+ * with churn recycles cache-hot entries without going through the allocator at all.
+ *
+ * Everything a table holds is charged to a memory cgroup: entries and values to the task storing them
+ * (SLAB_ACCOUNT, GFP_KERNEL_ACCOUNT), bucket arrays to the table's creator. A stashed entry stays
+ * charged to the task that refilled the stash.
+ */
+static const unsigned int ht530_class_size[] = { 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048 };
+#define ht530_nr_classes  ARRAY_SIZE(ht530_class_size)
+static struct kmem_cache *ht530_entry_cache[ht530_nr_classes];
+
+struct ht530_stash {   // per-CPU free list; touched with BHs off since RCU callbacks refill it from softirq
+   unsigned int nr;
+   struct ht_entry *objs[stash_max];
+};
+static struct ht530_stash __percpu *ht530_stash;
+
+static unsigned int stash_size;
+module_param(stash_size, uint, 0444);
+MODULE_PARM_DESC(stash_size, "smallest-class entries preallocated and recycled per CPU, at most 256 (default 0 = off)");
+
+static bool ht530_stash_push(struct ht_entry *e){   /// caller has BHs disabled
+   struct ht530_stash *st = this_cpu_ptr(ht530_stash);
+   if (st->nr >= stash_size)
+      return false;
+   st->objs[st->nr++] = e;
+   return true;
+}
+
+static void ht530_stash_refill(void){   /// top this CPU's stash back up to half full, stash_step entries per bulk allocation
+   void *objs[stash_step];
+   unsigned int want = stash_size / 2, got, i;
+
+   while (want) {
+      got = kmem_cache_alloc_bulk(ht530_entry_cache[0], GFP_KERNEL, min_t(unsigned int, want, stash_step), objs);
+      if (!got)
+         return;
+      want -= got;
+      i = 0;
+      local_bh_disable();   // we may have migrated CPUs while allocating, that's fine
+      while (i < got && ht530_stash_push(objs[i]))
+         i++;
+      local_bh_enable();
+      if (i < got) {   // frees filled it meanwhile
+         kmem_cache_free_bulk(ht530_entry_cache[0], got - i, &objs[i]);
+         return;
+      }
+   }
+}
+
+static size_t ht530_entry_size(unsigned int klen, u32 vlen, bool ordered){   /// header, key, inline value and index node
+   if (ordered)
+      return offsetof(struct ht_entry, key) + ALIGN(klen, 8) + ALIGN(vlen, 8) + sizeof(struct ht530_onode);
+   return offsetof(struct ht_entry, key) + ALIGN(klen, 8) + vlen;
+}
+
+static unsigned int ht530_class_of(size_t size){   /// smallest class holding size bytes, ht530_nr_classes if none
+   unsigned int c;
+
+   for (c = 0; c < ht530_nr_classes; c++)
+      if (size <= ht530_class_size[c])
+         break;
+   return c;
+}
+
+static size_t ht530_entry_bytes(const struct ht_entry *e){   /// memory e holds
+   size_t bytes = ht530_class_size[e->cls];
+
+   if (!ht530_val_inline(e))
+      bytes += e->vlen;
+   return bytes;
+}
+
+static unsigned int ht530_entry_class(unsigned int klen, u32 vlen, bool ordered, bool *inline_val){   /// size class of an entry, and whether its value fits in it
+   unsigned int cls = ht530_class_of(ht530_entry_size(klen, vlen, ordered));
+
+   *inline_val = cls < ht530_nr_classes;
+   if (!*inline_val)
+      cls = ht530_class_of(ht530_entry_size(klen, 0, ordered));   // always fits: HT530_KEY_MAX is well below the largest class
+   return cls;
+}
+
+static struct ht_entry *ht530_entry_setup(struct ht_entry *e, unsigned int cls, unsigned int klen, u32 vlen,
+                                          bool inline_val){   /// fill in a fresh object of class cls, freeing it on failure
+   e->cls = cls;
+   e->ref = 0;
+   e->klen = klen;
+   e->vlen = vlen;
+   e->expires = 0;
+   e->val = e->key + ALIGN(klen, 8);
+   if (!inline_val) {
+      e->val = kvmalloc(vlen, GFP_KERNEL_ACCOUNT);
+      if (!e->val) {
+         kmem_cache_free(ht530_entry_cache[cls], e);
+         return NULL;
+      }
+   }
+   return e;
+}
+
+/*
+ * Entry for a klen-byte key and vlen-byte value with klen, vlen and val set up; may sleep. Entries
+ * of ordered tables get room for their index node too.
+ */
+static struct ht_entry *ht530_entry_alloc(unsigned int klen, u32 vlen, bool ordered){
+   struct ht_entry *e = NULL;
+   struct ht530_stash *st;
+   bool inline_val;
+   unsigned int cls = ht530_entry_class(klen, vlen, ordered, &inline_val);
+
+   if (cls == 0 && stash_size) {
+      local_bh_disable();
+      st = this_cpu_ptr(ht530_stash);
+      if (st->nr)
+         e = st->objs[--st->nr];
+      local_bh_enable();
+      if (!e)
+         ht530_stash_refill();
+   }
+   if (!e)
+      e = kmem_cache_alloc(ht530_entry_cache[cls], GFP_KERNEL);
+   if (!e)
+      return NULL;
+   return ht530_entry_setup(e, cls, klen, vlen, inline_val);
+}
+
+/*
+ * Allocation for loads that create many entries in a row (HT530_SNAP_LOAD): objects come from
+ * kmem_cache_alloc_bulk, bulk_max of a class at a time, instead of one slab call per entry.
+ */
+#define bulk_max  64
+
+struct ht530_bulk {
+   unsigned int nr[ht530_nr_classes];
+   void *objs[ht530_nr_classes][bulk_max];
+};
+
+static struct ht_entry *ht530_bulk_alloc(struct ht530_bulk *b, unsigned int klen, u32 vlen, bool ordered){   /// as ht530_entry_alloc
+   bool inline_val;
+   unsigned int cls = ht530_entry_class(klen, vlen, ordered, &inline_val);
+
+   if (!b->nr[cls])
+      b->nr[cls] = kmem_cache_alloc_bulk(ht530_entry_cache[cls], GFP_KERNEL, bulk_max, b->objs[cls]);
+   if (!b->nr[cls])
+      return NULL;
+   return ht530_entry_setup(b->objs[cls][--b->nr[cls]], cls, klen, vlen, inline_val);
+}
+
+static void ht530_bulk_free(struct ht530_bulk *b){   /// give back what wasn't used
+   unsigned int c;
+
+   for (c = 0; c < ht530_nr_classes; c++)
+      if (b->nr[c])
+         kmem_cache_free_bulk(ht530_entry_cache[c], b->nr[c], b->objs[c]);
+}
+
+struct ht_entry *ht530_entry_alloc_int(const struct ht530_table *t){   /// entry for an int key and int value in t
+   return ht530_entry_alloc(sizeof(int), sizeof(int), t->ordered);
+}
+
+/// Have *spare ready for the next int put into t, false if out of memory. Open-addressing tables
+/// store ints in their buckets, so they never get one.
+bool ht530_spare_int(const struct ht530_table *t, struct ht_entry **spare){
+   if (t->open)
+      return true;
+   if (!*spare)
+      *spare = ht530_entry_alloc_int(t);
+   return *spare;
+}
+
+static void ht530_entry_release(struct ht_entry *e){   /// give e's memory back; BHs off or softirq if stash_size
+   if (!ht530_val_inline(e))
+      kvfree(e->val);
+   if (e->cls == 0 && stash_size && ht530_stash_push(e))
+      return;
+   kmem_cache_free(ht530_entry_cache[e->cls], e);
+}
+
+void ht530_entry_free(struct ht_entry *e){   /// e was never visible to readers
+   local_bh_disable();
+   ht530_entry_release(e);
+   local_bh_enable();
+}
+
+static void ht530_entry_free_rcu(struct rcu_head *head){   /// runs after every reader that could see the entry is gone
+   ht530_entry_release(container_of(head, struct ht_entry, rcu));   // softirq (or BH-off rcuo kthread) context
+}
+
+static void ht530_entry_cache_destroy(void){   /// after rcu_barrier(): give the stashes back, then the caches
+   struct ht530_stash *st;
+   unsigned int c;
+   int cpu;
+
+   if (ht530_stash) {
+      for_each_possible_cpu(cpu) {
+         st = per_cpu_ptr(ht530_stash, cpu);
+         if (st->nr)
+            kmem_cache_free_bulk(ht530_entry_cache[0], st->nr, (void **)st->objs);
+      }
+      free_percpu(ht530_stash);
+      ht530_stash = NULL;
+   }
+   for (c = 0; c < ht530_nr_classes; c++)
+      kmem_cache_destroy(ht530_entry_cache[c]);   // NULL is fine
+}
+
+static int ht530_entry_cache_create(void){   /// slab caches plus the initial per-CPU stashes
+   struct ht530_stash *st;
+   char name[24];
+   unsigned int c;
+   int cpu;
+
+   ht530_stash = alloc_percpu(struct ht530_stash);
+   if (!ht530_stash)
+      return -ENOMEM;
+   for (c = 0; c < ht530_nr_classes; c++) {
+      snprintf(name, sizeof(name), "ht530_entry-%u", ht530_class_size[c]);
+      ht530_entry_cache[c] = kmem_cache_create(name, ht530_class_size[c], __alignof__(struct ht_entry), SLAB_ACCOUNT, NULL);
+      if (!ht530_entry_cache[c]) {
+         ht530_entry_cache_destroy();
+         return -ENOMEM;
+      }
+   }
+   stash_size = min_t(unsigned int, stash_size, stash_max);
+   for_each_possible_cpu(cpu) {
+      st = per_cpu_ptr(ht530_stash, cpu);
+      st->nr = kmem_cache_alloc_bulk(ht530_entry_cache[0], GFP_KERNEL, stash_size, (void **)st->objs);
+   }
+   return 0;
+}
+
+static unsigned int ht530_wanted_bits(struct ht530_table *t, unsigned int cur, s64 nelems){   /// bucket count the entry count calls for
+   unsigned int new_bits = cur;
+   u64 want;
+
+   // size for the entries at max_load; when shrinking, leave one doubling of headroom
+   want = div_u64((u64)nelems * 100, max(max_load, 1U));
+   if ((u64)nelems * 100 > ((u64)max_load << cur) && cur < t->max_bits)
+      new_bits = clamp_t(unsigned int, order_base_2(want), cur + 1, t->max_bits);
+   else if ((u64)nelems * 100 < ((u64)min_load << cur) && cur > t->init_bits && !atomic_read(&t->loads))
+      new_bits = clamp_t(unsigned int, order_base_2(want) + 1, t->init_bits, cur - 1);
+   return new_bits;
+}
+
+static void ht530_resize_check(struct ht530_table *t, struct ht530_bucket_table *tbl){   /// kick the resize worker if tbl is over- or under-loaded
+   if (ht530_wanted_bits(t, tbl->nbits, percpu_counter_read_positive(&t->nelems)) != tbl->nbits)
+      schedule_work(&t->resize_work);
+}
+
+
+static bool ht530_watch_wants(const struct ht530_watcher *w, const void *key, unsigned int klen){   /// key passes w's filter
+   const struct ht530_rec *rec;
+   const u8 *p = w->keys;
+   u32 i;
+
+   if (!w->nkeys)
+      return true;
+   for (i = 0; i < w->nkeys; i++, p += HT530_REC_SIZE(rec->klen, 0)) {
+      rec = (const struct ht530_rec *)p;
+      if (rec->klen == klen && !memcmp(rec + 1, key, klen))
+         return true;
+   }
+   return false;
+}
+
+void ht530_watch_copy(struct ht530_watcher *w, const void *src, size_t len){   /// append at head, wrapping around
+   size_t off = w->head & (w->size - 1), n = min_t(size_t, len, w->size - off);
+
+   memcpy(w->buf + off, src, n);
+   memcpy(w->buf, (const u8 *)src + n, len - n);
+   w->head += len;
+}
+
+static void ht530_watch_push(struct ht530_watcher *w, u64 seq, u32 op, const void *key, unsigned int klen,
+                             const void *val, u32 vlen){   /// under watch_lock
+   static const u8 zero[8];
+   struct ht530_change c = { .seq = seq, .op = op, .klen = klen, .vlen = vlen };
+   size_t len = HT530_CHANGE_SIZE(klen, vlen), ovf = w->lost ? HT530_CHANGE_SIZE(0, 0) : 0;
+
+   if (w->head - w->tail + ovf + len > w->size) {
+      if (!w->lost++)
+         w->lost_seq = seq;
+      return;   // the reader was woken for what's already there
+   }
+   if (ovf) {   // there's room again: tell the reader about the gap first
+      struct ht530_change o = { .seq = w->lost_seq, .op = HT530_CHANGE_OVERFLOW };
+
+      ht530_watch_copy(w, &o, sizeof(o));
+      w->lost = 0;
+   }
+   ht530_watch_copy(w, &c, sizeof(c));
+   ht530_watch_copy(w, key, klen);
+   ht530_watch_copy(w, val, vlen);
+   ht530_watch_copy(w, zero, len - sizeof(c) - klen - vlen);
+   wake_up_interruptible(&w->wait);
+}
+
+/*
+ * Read-only view (view_bits, layout in ht530_ioctl.h). ht530_changed keeps it in step with the table,
+ * under the key's bucket lock, so one key's changes reach its line in order; the line's seq, taken odd
+ * with cmpxchg, also serialises writers of different keys that share the line. A line holds a key in
+ * a slot or counts it in ovf, never both: ovf goes up for a key that doesn't fit and down when such a
+ * key is deleted or moves into a slot. A saturated ovf stays until the table goes away.
+ */
+static struct ht530_view_line *ht530_view_line(const struct ht530_table *t, int key){
+   const struct ht530_view_hdr *v = t->view;
+
+   return &t->view_lines[(((u64)(u32)key ^ v->seed) * v->mul) >> (64 - v->nbits)];
+}
+
+static u32 ht530_view_lock(struct ht530_view_line *l){   /// make l's seq odd, returning the even value it had
+   u32 seq;
+
+   for (;;) {
+      seq = READ_ONCE(l->seq);
+      if (!(seq & 1) && cmpxchg(&l->seq, seq, seq + 1) == seq)   // full barrier: seq is odd before the slots change
+         return seq;
+      cpu_relax();
+   }
+}
+
+static void ht530_view_ovf(struct ht530_view_line *l, int delta){
+   if (l->ovf != 0xff)
+      WRITE_ONCE(l->ovf, l->ovf + delta);
+}
+
+static void ht530_view_note(struct ht530_table *t, u32 op, const void *key, const void *val, u32 vlen,
+                            unsigned long expires){   /// the change of an int key, for the view
+   struct ht530_view_line *l;
+   unsigned int i, slot = HT530_VIEW_SLOTS;
+   bool fits = vlen == sizeof(int) && !expires && op != HT530_CHANGE_DELETE;
+   int k, data = 0;
+   u32 seq;
+
+   memcpy(&k, key, sizeof(k));
+   if (fits)
+      memcpy(&data, val, sizeof(data));
+   l = ht530_view_line(t, k);
+   seq = ht530_view_lock(l);
+   for (i = 0; i < HT530_VIEW_SLOTS; i++) {
+      if ((l->used & (1U << i)) && (u32)l->slot[i] == (u32)k) {
+         slot = i;
+         break;
+      }
+   }
+   if (slot < HT530_VIEW_SLOTS) {   // in the line: update or take out
+      if (fits) {
+         WRITE_ONCE(l->slot[slot], (u32)k | (u64)(u32)data << 32);
+      } else {
+         WRITE_ONCE(l->used, l->used & ~(1U << slot));
+         if (op != HT530_CHANGE_DELETE)
+            ht530_view_ovf(l, 1);
+      }
+   } else if (op == HT530_CHANGE_DELETE) {   // was counted in ovf
+      ht530_view_ovf(l, -1);
+   } else if (fits && l->used != (1U << HT530_VIEW_SLOTS) - 1) {   // a free slot: move in
+      slot = __ffs64(~(u64)l->used);
+      WRITE_ONCE(l->slot[slot], (u32)k | (u64)(u32)data << 32);
+      WRITE_ONCE(l->used, l->used | (1U << slot));
+      if (op == HT530_CHANGE_REPLACE)
+         ht530_view_ovf(l, -1);
+   } else if (op == HT530_CHANGE_INSERT) {   // a replaced key that doesn't fit is already counted
+      ht530_view_ovf(l, 1);
+   }
+   smp_store_release(&l->seq, seq + 2);
+}
+
+/// Log a change of key for the table's watchers and view; the caller holds the key's bucket lock.
+/// expires is that of the changed entry, for the view.
+static void ht530_changed(struct ht530_table *t, u32 op, const void *key, unsigned int klen,
+                          const void *val, u32 vlen, unsigned long expires){
+   struct ht530_watcher *w;
+   u64 seq;
+
+   if (t->view && klen == sizeof(int))
+      ht530_view_note(t, op, key, val, vlen, expires);
+   if (likely(list_empty(&t->watchers)))
+      return;
+   spin_lock(&t->watch_lock);
+   seq = ++t->change_seq;
+   list_for_each_entry(w, &t->watchers, node)
+      if (ht530_watch_wants(w, key, klen))
+         ht530_watch_push(w, seq, op, key, klen, val, vlen);
+   spin_unlock(&t->watch_lock);
+}
+
+static inline void ht530_changed_int(struct ht530_table *t, u32 op, int key, int data){   /// as ht530_changed, for an int pair
+   ht530_changed(t, op, &key, sizeof(key), &data, op == HT530_CHANGE_DELETE ? 0 : sizeof(data), 0);
+}
+
+static inline void ht530_changed_entry(struct ht530_table *t, u32 op, const struct ht_entry *e){   /// as ht530_changed, for e's pair
+   ht530_changed(t, op, e->key, e->klen, e->val, op == HT530_CHANGE_DELETE ? 0 : e->vlen, e->expires);
+}
+
+/*
+ * Buckets a writer holds for one key. future is only set when the key's bucket in tbl has already
+ * been copied into the next generation, in which case both generations are kept in step.
+ */
+struct ht530_wlock {
+   struct ht530_table *t;
+   struct ht530_bucket_table *tbl, *future;
+   unsigned int bkt, fbkt;
+   u32 hash, fhash;            // the key's hash in each
+   u64 wait;                   // ns spent waiting for the stripes, while profiling
+};
+
+static void ht530_write_lock(struct ht530_table *t, struct ht530_wlock *w, const void *key, unsigned int klen){
+   struct ht530_bucket_table *future;
+
+   rcu_read_lock();   // keeps tbl (and future) alive even if a resize publishes a new generation meanwhile
+   w->t = t;
+   w->tbl = rcu_dereference(t->tbl);
+   w->hash = ht530_hash(&w->tbl->key, key, klen);
+   w->bkt = ht530_bucket(w->tbl, w->hash);
+   w->wait = ht530_lock_stripe(t, ht530_bucket_lock(w->tbl, w->bkt), 0);
+
+   // the resize worker advances rehash past bkt only while holding this bucket's lock
+   future = rcu_dereference(w->tbl->future);
+   if (future && w->bkt < READ_ONCE(w->tbl->rehash)) {
+      w->future = future;
+      w->fhash = ht530_hash(&future->key, key, klen);   // differs from hash after a reseed
+      w->fbkt = ht530_bucket(future, w->fhash);
+      w->wait += ht530_lock_stripe(t, ht530_bucket_lock(future, w->fbkt), SINGLE_DEPTH_NESTING);
+   } else {
+      w->future = NULL;
+   }
+   if (unlikely(w->wait))
+      ht530_hot_note(t, hot_contended, key, klen);
+}
+
+static void ht530_write_unlock(struct ht530_wlock *w){
+   if (w->future)
+      spin_unlock(ht530_bucket_lock(w->future, w->fbkt));
+   spin_unlock(ht530_bucket_lock(w->tbl, w->bkt));
+   rcu_read_unlock();
+}
+
+static struct ht_entry *ht530_write_find(struct ht530_wlock *w, const void *key,
+                                         unsigned int klen){   /// entry with key, under ht530_write_lock
+   if (w->future)
+      return ht530_find(&w->future->buckets[w->fbkt], w->future->gen, w->fhash, key, klen);
+   return ht530_find(&w->tbl->buckets[w->bkt], w->tbl->gen, w->hash, key, klen);
+}
+
+/// After an insert into bucket bkt of tbl: ask for a reseed if its chain is far longer than average.
+static void ht530_chain_check(struct ht530_table *t, struct ht530_bucket_table *tbl, unsigned int bkt){
+   unsigned int limit = READ_ONCE(t->chain_max), len = 0;
+   s64 nelems = percpu_counter_read_positive(&t->nelems);
+   struct hlist_node *n;
+
+   if (!limit || READ_ONCE(t->reseed) || rcu_access_pointer(tbl->future))
+      return;   // a rehash under way may fix it anyway; the next insert checks again
+   if (ht530_wanted_bits(t, tbl->nbits, nelems) > tbl->nbits)
+      return;   // the inserts are ahead of the resize worker, the grow it owes comes first
+   // a table stuck at max_bits has long chains all over, only an outlier says the hash is being gamed
+   limit += nelems >> tbl->nbits;
+   for (n = rcu_dereference_raw(hlist_first_rcu(&tbl->buckets[bkt])); n && len <= limit;
+        n = rcu_dereference_raw(hlist_next_rcu(n)))
+      len++;
+   if (len <= limit)
+      return;
+   WRITE_ONCE(t->reseed, true);
+   schedule_work(&t->resize_work);
+}
+
+static void ht530_index_insert(struct ht530_table *t, struct ht_entry *e){   /// under a bucket lock
+   struct rb_node **p = &t->index.rb_node, *parent = NULL;
+   struct ht530_onode *on = ht530_entry_onode(e);
+   struct ht_entry *cur;
+
+   ht530_lock_stripe(t, &t->index_lock, 0);
+   while (*p) {
+      parent = *p;
+      cur = rb_entry(parent, struct ht530_onode, rb)->e;
+      p = ht530_key_cmp(e->key, e->klen, cur->key, cur->klen) < 0 ? &parent->rb_left : &parent->rb_right;
+   }
+   on->e = e;
+   rb_link_node(&on->rb, parent, p);
+   rb_insert_color(&on->rb, &t->index);
+   spin_unlock(&t->index_lock);
+}
+
+/*
+ * Writers count an entry into the filter before linking it and out after unlinking it, so a lookup
+ * that starts once the put has returned can't be turned away, and one racing the put may miss the key
+ * either way. Keys under different bucket locks share counter words, hence the cmpxchg. A counter
+ * that reaches 255 stays there: it has lost count of its keys and can never safely reach 0 again.
+ */
+static inline u64 ht530_bloom_hash(const struct ht530_table *t, const void *key, unsigned int klen){
+   return (u64)ht530_hash(&t->bloom_key, key, klen) * 0x9e3779b97f4a7c15ULL;   // block from the top bits, counters from the bottom
+}
+
+static inline u32 *ht530_bloom_block(const struct ht530_table *t, u64 h){
+   return t->bloom + (h >> (64 - (t->bloom_bits - 6))) * (bloom_block / 4);
+}
+
+static bool ht530_bloom_may_have(const struct ht530_table *t, const void *key, unsigned int klen){   /// false: key is certainly absent
+   u64 h = ht530_bloom_hash(t, key, klen);
+   const u32 *block = ht530_bloom_block(t, h);
+   unsigned int i;
+
+   for (i = 0; i < bloom_k; i++) {
+      if (!ht530_bloom_counter(block, (h >> (6 * i)) % bloom_block))
+         return false;
+   }
+   return true;
+}
+
+static void ht530_bloom_count(struct ht530_table *t, const void *key, unsigned int klen, bool add){   /// count key in or out
+   u64 h = ht530_bloom_hash(t, key, klen);
+   u32 *word, *block = ht530_bloom_block(t, h);
+   unsigned int i, slot, shift, cnt;
+   u32 old, new;
+
+   for (i = 0; i < bloom_k; i++) {
+      slot = (h >> (6 * i)) % bloom_block;
+      word = &block[slot / 4];
+      shift = slot % 4 * 8;
+      do {
+         old = READ_ONCE(*word);
+         cnt = (old >> shift) & 0xff;
+         if (cnt == 0xff || (!add && !cnt))
+            break;
+         new = add ? old + (1U << shift) : old - (1U << shift);
+      } while (cmpxchg(word, old, new) != old);
+   }
+}
+
+static void ht530_write_link(struct ht530_wlock *w, struct ht_entry *e){   /// add e to every live generation
+   if (w->t->bloom)
+      ht530_bloom_count(w->t, e->key, e->klen, true);
+   if (w->t->ordered)
+      ht530_index_insert(w->t, e);
+   e->hash[w->tbl->gen] = w->hash;
+   hlist_add_head_rcu(&e->node[w->tbl->gen], &w->tbl->buckets[w->bkt]);
+   e->linked[w->tbl->gen] = 1;
+   if (w->future) {
+      e->hash[w->future->gen] = w->fhash;
+      hlist_add_head_rcu(&e->node[w->future->gen], &w->future->buckets[w->fbkt]);
+      e->linked[w->future->gen] = 1;
+      ht530_chain_check(w->t, w->future, w->fbkt);
+   } else {
+      ht530_chain_check(w->t, w->tbl, w->bkt);
+   }
+   percpu_counter_inc(&w->t->nelems);
+   percpu_counter_add(&w->t->mem, ht530_entry_bytes(e));
+   ht530_changed_entry(w->t, HT530_CHANGE_INSERT, e);
+   ht530_resize_check(w->t, w->tbl);
+}
+
+static void ht530_write_unlink(struct ht530_wlock *w, struct ht_entry *e){   /// remove e (found by ht530_write_find), free after a grace period
+   if (w->future) {
+      hlist_del_rcu(&e->node[w->future->gen]);
+      e->linked[w->future->gen] = 0;
+   }
+   // e may have been added straight to the future generation after it was published, by a writer
+   // that no longer saw this one; in that case it was never on the tbl chain
+   if (e->linked[w->tbl->gen]) {
+      hlist_del_rcu(&e->node[w->tbl->gen]);
+      e->linked[w->tbl->gen] = 0;
+   }
+   if (w->t->ordered) {   // out of the index before the grace period starts, scans hold index_lock
+      ht530_lock_stripe(w->t, &w->t->index_lock, 0);
+      rb_erase(&ht530_entry_onode(e)->rb, &w->t->index);
+      spin_unlock(&w->t->index_lock);
+   }
+   if (w->t->bloom)
+      ht530_bloom_count(w->t, e->key, e->klen, false);
+   percpu_counter_dec(&w->t->nelems);
+   percpu_counter_sub(&w->t->mem, ht530_entry_bytes(e));
+   ht530_changed_entry(w->t, HT530_CHANGE_DELETE, e);
+   call_rcu(&e->rcu, ht530_entry_free_rcu);
+   ht530_resize_check(w->t, w->tbl);
+}
+
+/// Put new (same key) in old's place on every live generation, free old after a grace period.
+static void ht530_write_replace(struct ht530_wlock *w, struct ht_entry *old, struct ht_entry *new){
+   new->linked[0] = new->linked[1] = 0;
+   new->hash[0] = old->hash[0];
+   new->hash[1] = old->hash[1];
+   if (w->future) {
+      hlist_replace_rcu(&old->node[w->future->gen], &new->node[w->future->gen]);
+      old->linked[w->future->gen] = 0;
+      new->linked[w->future->gen] = 1;
+   }
+   if (old->linked[w->tbl->gen]) {   // see ht530_write_unlink
+      hlist_replace_rcu(&old->node[w->tbl->gen], &new->node[w->tbl->gen]);
+      old->linked[w->tbl->gen] = 0;
+      new->linked[w->tbl->gen] = 1;
+   }
+   if (w->t->ordered) {
+      ht530_lock_stripe(w->t, &w->t->index_lock, 0);
+      ht530_entry_onode(new)->e = new;
+      rb_replace_node(&ht530_entry_onode(old)->rb, &ht530_entry_onode(new)->rb, &w->t->index);
+      spin_unlock(&w->t->index_lock);
+   }
+   percpu_counter_add(&w->t->mem, (s64)ht530_entry_bytes(new) - (s64)ht530_entry_bytes(old));
+   ht530_changed_entry(w->t, HT530_CHANGE_REPLACE, new);
+   call_rcu(&old->rcu, ht530_entry_free_rcu);
+}
+
+/// Move everything to a 2^new_bits generation, under a new hash key if reseed.
+static int ht530_rehash(struct ht530_table *t, struct ht530_bucket_table *old, unsigned int new_bits, bool reseed){
+   struct ht530_bucket_table *new;
+   struct ht_entry *e;
+   struct hlist_node *n;
+   unsigned int b, nb, obits = old->nbits;
+   spinlock_t *lock, *nlock;
+
+   new = ht530_bucket_table_alloc(new_bits, !old->gen);
+   if (!new) {
+      printk(KERN_WARNING "ht530: no memory to resize table %u to %u buckets\n", t->id, 1U << new_bits);
+      return -ENOMEM;
+   }
+   if (reseed) {
+      new->epoch = old->epoch + 1;
+      WRITE_ONCE(t->reseed, false);
+      ht530_stat_inc(t, reseeds);
+      printk(KERN_WARNING "ht530: table %u has a chain over chain_max, rehashing under a new hash key\n", t->id);
+   } else {
+      new->epoch = old->epoch;
+      new->key = old->key;   // hashes carry over, buckets only split or merge
+   }
+   rcu_assign_pointer(old->future, new);
+
+   for (b = 0; b < (1U << obits); b++) {
+      lock = ht530_bucket_lock(old, b);
+      spin_lock(lock);
+      ht530_for_each_entry(e, n, &old->buckets[b], old->gen){
+         e->hash[new->gen] = reseed ? ht530_hash(&new->key, e->key, e->klen) : e->hash[old->gen];
+         nb = ht530_bucket(new, e->hash[new->gen]);
+         nlock = ht530_bucket_lock(new, nb);
+         spin_lock_nested(nlock, SINGLE_DEPTH_NESTING);
+         hlist_add_head_rcu(&e->node[new->gen], &new->buckets[nb]);
+         e->linked[new->gen] = 1;
+         spin_unlock(nlock);
+      }
+      WRITE_ONCE(old->rehash, b + 1);   // from here on writers to bucket b update both generations
+      spin_unlock(lock);
+      if ((b & 255) == 255)
+         cond_resched();
+   }
+
+   rcu_assign_pointer(t->tbl, new);
+   synchronize_rcu();   // no reader or writer can still be using old after this
+   ht530_bucket_table_free(old);
+   printk(KERN_INFO "ht530: table %u resized from %u to %u buckets\n", t->id, 1U << obits, 1U << new_bits);
+   return 0;
+}
+
+static void ht530_resize_work(struct work_struct *work){
+   struct ht530_table *t = container_of(work, struct ht530_table, resize_work);
+   struct ht530_bucket_table *tbl;
+   unsigned int new_bits;
+   bool reseed;
+
+   mutex_lock(&t->resize_mutex);
+   memalloc_use_memcg(t->memcg);   // new bucket arrays are the table's, not the worker's
+   for (;;) {   // entries keep arriving while we rehash, re-check until the size fits
+      tbl = rcu_dereference_protected(t->tbl, lockdep_is_held(&t->resize_mutex));
+      new_bits = ht530_wanted_bits(t, tbl->nbits, percpu_counter_sum_positive(&t->nelems));
+      reseed = READ_ONCE(t->reseed);
+      if ((new_bits == tbl->nbits && !reseed) || ht530_rehash(t, tbl, new_bits, reseed))
+         break;
+   }
+   memalloc_unuse_memcg();
+   mutex_unlock(&t->resize_mutex);
+}
+
+/*
+ * Budget and TTL. Eviction is CLOCK over buckets: a lookup hit sets the entry's reference bit (a plain
+ * store, and only if it isn't set already, so the read path stays lock-free and mostly read-only), and
+ * a hand sweeps the buckets, clearing set bits and dropping entries whose bit is already clear. New
+ * entries start referenced, so each survives at least one turn of the hand. The writer that takes a
+ * table over budget runs the hand itself until the table is back under it.
+ *
+ * Expired entries are dropped lazily: lookups treat them as absent, writers replace or remove them,
+ * and the hand and the periodic reaper free them as they come across them.
+ *
+ * Memory reclaim turns the same hand on cache tables (see ht530_shrink_scan), and empties idle ones.
+ */
+#define sweep_reap     0   /// expired entries only
+#define sweep_evict    1   /// CLOCK, for the budget
+#define sweep_reclaim  2   /// CLOCK, for the shrinker
+#define sweep_drop     3   /// every entry, for the shrinker
+
+static unsigned int ht530_sweep_bucket(struct ht530_table *t, unsigned int hand, int mode){   /// one bucket for the hand, the reaper or the shrinker, returns entries dropped
+   struct ht530_bucket_table *future;
+   struct ht530_wlock w;
+   struct ht_entry *e;
+   struct hlist_node *n;
+   unsigned int dropped = 0;
+   bool expired;
+
+   rcu_read_lock();
+   w.t = t;
+   w.tbl = rcu_dereference(t->tbl);
+   w.bkt = hand & ((1U << w.tbl->nbits) - 1);
+   ht530_lock_stripe(t, ht530_bucket_lock(w.tbl, w.bkt), 0);
+   // as in ht530_write_lock: a copied bucket's entries are also on future chains, unlink from both
+   future = rcu_dereference(w.tbl->future);
+   if (!future || w.bkt >= READ_ONCE(w.tbl->rehash))
+      future = NULL;
+   ht530_for_each_entry(e, n, &w.tbl->buckets[w.bkt], w.tbl->gen){
+      expired = ht530_expired(e);
+      if (!expired && mode == sweep_reap)
+         continue;
+      if (!expired && mode != sweep_drop && READ_ONCE(e->ref)) {
+         WRITE_ONCE(e->ref, 0);   // second chance
+         continue;
+      }
+      w.future = future;
+      if (future) {
+         w.fbkt = ht530_bucket(future, e->hash[future->gen]);
+         ht530_lock_stripe(t, ht530_bucket_lock(future, w.fbkt), SINGLE_DEPTH_NESTING);
+         if (!e->linked[future->gen]) {   // future got published and a writer there deleted e, which left it on our chain
+            spin_unlock(ht530_bucket_lock(future, w.fbkt));
+            continue;
+         }
+      }
+      if (expired) {
+         ht530_stat_inc(t, expired);
+         trace_ht530_expire(t->id, e->key, e->klen, e->vlen);
+      } else {
+         if (mode == sweep_evict)
+            ht530_stat_inc(t, evictions);
+         else
+            ht530_stat_inc(t, reclaimed);
+         trace_ht530_evict(t->id, e->key, e->klen, e->vlen);
+      }
+      ht530_write_unlink(&w, e);
+      if (future)
+         spin_unlock(ht530_bucket_lock(future, w.fbkt));
+      dropped++;
+   }
+   spin_unlock(ht530_bucket_lock(w.tbl, w.bkt));
+   rcu_read_unlock();
+   return dropped;
+}
+
+static bool ht530_over_budget(struct ht530_table *t){
+   u64 me = READ_ONCE(t->max_entries), mb = READ_ONCE(t->max_bytes);
+
+   // percpu_counter_compare only sums the per-CPU deltas when the estimate is too close to call
+   return (me && percpu_counter_compare(&t->nelems, me) > 0) ||
+          (mb && percpu_counter_compare(&t->mem, mb) > 0);
+}
+
+static void ht530_enforce_budget(struct ht530_table *t){   /// after an insert: evict until back under budget
+   unsigned int scanned, limit;
+
+   if (!ht530_over_budget(t))
+      return;
+   rcu_read_lock();
+   limit = 2U << rcu_dereference(t->tbl)->nbits;   // two turns: the first may only clear reference bits
+   rcu_read_unlock();
+   for (scanned = 0; scanned < limit; scanned++) {
+      if (ht530_sweep_bucket(t, atomic_inc_return(&t->clock_hand), sweep_evict) && !ht530_over_budget(t))
+         break;
+      if ((scanned & 255) == 255)
+         cond_resched();
+   }
+}
+
+#define reap_batch  4096   /// buckets the reaper visits per run
+
+static void ht530_reap_work(struct work_struct *work){   /// periodic sweep for expired entries
+   struct ht530_table *t = container_of(to_delayed_work(work), struct ht530_table, reap_work);
+   unsigned int i, nb, ms = READ_ONCE(reap_ms);
+
+   rcu_read_lock();
+   nb = 1U << rcu_dereference(t->tbl)->nbits;
+   rcu_read_unlock();
+   for (i = 0; i < min_t(unsigned int, nb, reap_batch); i++) {
+      ht530_sweep_bucket(t, t->reap_pos++, sweep_reap);
+      if ((i & 255) == 255)
+         cond_resched();
+   }
+   if (ms)
+      schedule_delayed_work(&t->reap_work, msecs_to_jiffies(ms));
+}
+
+static void ht530_reap_start(struct ht530_table *t){   /// the first entry with a TTL starts the reaper
+   unsigned int ms = READ_ONCE(reap_ms);
+
+   if (likely(READ_ONCE(t->has_ttl)) || !ms)
+      return;
+   WRITE_ONCE(t->has_ttl, true);
+   schedule_delayed_work(&t->reap_work, msecs_to_jiffies(ms));   // no-op if a racing writer got there first
+}
+
+/*
+ * Memory pressure. Cache tables (HT530_TABLE_CACHE) are on ht530_cache_tables, and the shrinker
+ * counts their entries as reclaimable. A scan first empties every cache table that has seen no
+ * operation for reclaim_idle_ms, then runs the CLOCK hand of the others, a table at a time and
+ * starting one table further on each scan, until it has freed what reclaim asked for. Freed
+ * entries go back to the slab after a grace period, as ever.
+ *
+ * The shrinker is global, not memcg-aware: entries aren't kept on per-memcg lists, so a cgroup at
+ * its own limit gets no help from it, but its tables are charged to it and its OOM stays its own.
+ */
+static LIST_HEAD(ht530_cache_tables);
+static DEFINE_MUTEX(ht530_cache_lock);      /// guards ht530_cache_tables and the tables' reclaim_* fields
+
+static bool ht530_table_idle(struct ht530_table *t){   /// no operations for reclaim_idle_ms; under ht530_cache_lock
+   unsigned int ms = READ_ONCE(reclaim_idle_ms);
+   struct ht530_stats *st;
+   u64 ops = 0;
+   int cpu;
+
+   for_each_possible_cpu(cpu) {
+      st = per_cpu_ptr(t->stats, cpu);
+      ops += READ_ONCE(st->gets) + READ_ONCE(st->inserts) + READ_ONCE(st->replaces) + READ_ONCE(st->deletes);
+   }
+   if (ops != t->reclaim_ops) {
+      t->reclaim_ops = ops;
+      t->reclaim_stamp = jiffies;
+      return false;
+   }
+   return ms && time_after_eq(jiffies, t->reclaim_stamp + msecs_to_jiffies(ms));
+}
+
+static unsigned long ht530_table_drop(struct ht530_table *t){   /// empty t, returns entries dropped
+   unsigned long dropped = 0;
+   unsigned int bkt, nb;
+
+   rcu_read_lock();
+   nb = 1U << rcu_dereference(t->tbl)->nbits;
+   rcu_read_unlock();
+   for (bkt = 0; bkt < nb; bkt++) {   // a resize meanwhile may leave a few entries behind, fine
+      dropped += ht530_sweep_bucket(t, bkt, sweep_drop);
+      if ((bkt & 255) == 255)
+         cond_resched();
+   }
+   ht530_stat_inc(t, idle_drops);
+   printk(KERN_INFO "ht530: table %u idle, reclaimed %lu entries\n", t->id, dropped);
+   return dropped;
+}
+
+static unsigned long ht530_shrink_count(struct shrinker *s, struct shrink_control *sc){
+   struct ht530_table *t;
+   unsigned long n = 0;
+
+   mutex_lock(&ht530_cache_lock);
+   list_for_each_entry(t, &ht530_cache_tables, cache_node)
+      n += percpu_counter_read_positive(&t->nelems);
+   mutex_unlock(&ht530_cache_lock);
+   return n ? n : SHRINK_EMPTY;
+}
+
+static unsigned long ht530_shrink_scan(struct shrinker *s, struct shrink_control *sc){
+   struct ht530_table *t;
+   unsigned long freed = 0;
+   unsigned int scanned, limit;
+
+   mutex_lock(&ht530_cache_lock);
+   list_for_each_entry(t, &ht530_cache_tables, cache_node) {
+      if (percpu_counter_read_positive(&t->nelems) && ht530_table_idle(t))
+         freed += ht530_table_drop(t);
+   }
+   list_for_each_entry(t, &ht530_cache_tables, cache_node) {
+      if (freed >= sc->nr_to_scan)
+         break;
+      rcu_read_lock();
+      limit = 2U << rcu_dereference(t->tbl)->nbits;   // two turns, as in ht530_enforce_budget
+      rcu_read_unlock();
+      for (scanned = 0; scanned < limit && freed < sc->nr_to_scan; scanned++) {
+         freed += ht530_sweep_bucket(t, atomic_inc_return(&t->clock_hand), sweep_reclaim);
+         if ((scanned & 255) == 255)
+            cond_resched();
+      }
+   }
+   if (!list_empty(&ht530_cache_tables))   // the next scan starts with the next table
+      list_move_tail(ht530_cache_tables.next, &ht530_cache_tables);
+   mutex_unlock(&ht530_cache_lock);
+   return freed ? freed : SHRINK_STOP;
+}
+
+static struct shrinker ht530_shrinker = {
+   .count_objects = ht530_shrink_count,
+   .scan_objects = ht530_shrink_scan,
+   .seeks = DEFAULT_SEEKS,
+};
+
+/*
+ * Lock-free lookup: copy at most cap bytes of key's value to buf. Returns the full value length, or
+ * -ENOENT if key isn't there.
+ */
+static int ht530_kv_get(struct ht530_table *t, const void *key, unsigned int klen, void *buf, u32 cap){
+   struct ht530_bucket_table *tbl;
+   struct ht_entry *e;
+   u64 start = ht530_lat_start();
+   u32 hash;
+   int ret = -ENOENT;
+
+   // Writers unlink with the _rcu list ops and only free entries after a grace period, so the chain
+   // stays walkable under rcu_read_lock. A resize in progress is invisible here: the current
+   // generation stays complete until it is replaced.
+   rcu_read_lock();
+   if (t->bloom && !ht530_bloom_may_have(t, key, klen)) {
+      e = NULL;
+      ht530_stat_inc(t, bloom_skips);
+   } else {
+      tbl = rcu_dereference(t->tbl);
+      hash = ht530_hash(&tbl->key, key, klen);
+      e = ht530_find(&tbl->buckets[ht530_bucket(tbl, hash)], tbl->gen, hash, key, klen);
+      if (!e && t->bloom)
+         ht530_stat_inc(t, bloom_fps);
+   }
+   if (e && ht530_expired(e)) {
+      ht530_stat_inc(t, expired);   // left for a writer, the hand or the reaper to free
+      e = NULL;
+   }
+   if (e) {
+      ht530_entry_read_val(e, buf, min(cap, e->vlen));
+      ret = e->vlen;
+      if (!READ_ONCE(e->ref))
+         WRITE_ONCE(e->ref, 1);   // don't dirty the line when it's already set
+   }
+   rcu_read_unlock();
+   ht530_stat_inc(t, gets);
+   if (ret >= 0) {
+      ht530_stat_inc(t, hits);
+      trace_ht530_hit(t->id, key, klen, ret);
+   } else {
+      ht530_stat_inc(t, misses);
+      trace_ht530_miss(t->id, key, klen);
+   }
+   if (start) {
+      ht530_hot_sample(t, key, klen);
+      ht530_lat_end(t, lat_get, start, 0);
+   }
+   return ret;
+}
+
+/*
+ * Insert or replace. *spare is a complete entry (key and value filled in; the allocation may sleep,
+ * so it can't happen under the bucket lock). It is consumed and set to NULL when it goes into the
+ * table, which is on insert and on a replace that changes the value's size or isn't a 4/8-byte value;
+ * a same-size 4/8-byte value is stored in place and *spare is left for the caller. The caller sets
+ * (*spare)->expires. An insert that takes the table over budget evicts before returning.
+ * Returns 1 if an existing value was replaced, 0 if the key was inserted (or only had an expired one).
+ */
+static int ht530_kv_put(struct ht530_table *t, struct ht_entry **spare){
+   struct ht530_wlock w;
+   struct ht_entry *e, *n = *spare;
+   u64 start = ht530_lat_start();
+   int replaced = 0;
+
+   n->ref = 1;
+   if (n->expires)
+      ht530_reap_start(t);
+   ht530_write_lock(t, &w, n->key, n->klen);
+   e = ht530_write_find(&w, n->key, n->klen);
+   if (e && ht530_expired(e))
+      ht530_stat_inc(t, expired);   // replaced below all the same, but it counts as an insert
+   else if (e)
+      replaced = 1;
+   if (e && e->vlen == n->vlen && n->vlen == sizeof(u32)) {
+      WRITE_ONCE(*(u32 *)e->val, *(u32 *)n->val);   // readers may be looking at it without the lock
+      WRITE_ONCE(e->expires, n->expires);
+      WRITE_ONCE(e->ref, 1);
+   } else if (e && e->vlen == n->vlen && n->vlen == sizeof(u64)) {
+      WRITE_ONCE(*(u64 *)e->val, *(u64 *)n->val);
+      WRITE_ONCE(e->expires, n->expires);
+      WRITE_ONCE(e->ref, 1);
+   } else if (e) {
+      *spare = NULL;
+      ht530_write_replace(&w, e, n);
+   } else {
+      *spare = NULL;
+      n->linked[0] = n->linked[1] = 0;
+      ht530_write_link(&w, n);
+   }
+   if (*spare)   // stored in place, which the link/replace helpers didn't see
+      ht530_changed_entry(t, HT530_CHANGE_REPLACE, e);
+   if (replaced) {   // still under the lock: once in the table, n may be deleted as soon as we let go
+      ht530_stat_inc(t, replaces);
+      trace_ht530_replace(t->id, n->key, n->klen, n->vlen);
+   } else {
+      ht530_stat_inc(t, inserts);
+      trace_ht530_insert(t->id, n->key, n->klen, n->vlen);
+   }
+   if (start)
+      ht530_hot_sample(t, n->key, n->klen);
+   ht530_write_unlock(&w);
+   if (!replaced)
+      ht530_enforce_budget(t);
+   if (start)
+      ht530_lat_end(t, lat_put, start, w.wait);
+   return replaced;
+}
+
+/// Remove key, copying at most cap bytes of the value it had to buf. Returns that value's length or -ENOENT.
+static int ht530_kv_del(struct ht530_table *t, const void *key, unsigned int klen, void *buf, u32 cap){
+   struct ht530_wlock w;
+   struct ht_entry *e;
+   u64 start = ht530_lat_start();
+   int ret = -ENOENT;
+
+   ht530_write_lock(t, &w, key, klen);
+   e = ht530_write_find(&w, key, klen);
+   if (e && ht530_expired(e)) {
+      ht530_stat_inc(t, expired);
+      ht530_write_unlink(&w, e);
+      e = NULL;
+   } else if (e) {
+      ret = e->vlen;
+      ht530_entry_read_val(e, buf, min(cap, e->vlen));
+      ht530_write_unlink(&w, e);
+   }
+   ht530_write_unlock(&w);
+   if (e) {
+      ht530_stat_inc(t, deletes);
+      trace_ht530_delete(t->id, key, klen, ret);
+   }
+   if (start) {
+      ht530_hot_sample(t, key, klen);
+      ht530_lat_end(t, lat_del, start, w.wait);
+   }
+   return ret;
+}
+
+
+static inline u64 ht530_oa_zero_bytes(u64 x){   /// 0x80 in every byte of x that is 0, exactly (no carries between bytes)
+   return ~(((x & oa_lows) + oa_lows) | x | oa_lows);
+}
+
+static inline u64 ht530_oa_match(u64 ctrl, u8 tag){   /// 0x80 in the byte of every slot tagged tag
+   return ht530_oa_zero_bytes(ctrl ^ (oa_ones * tag)) & ~(0xffULL << oa_ovf_shift);
+}
+
+static inline u8 ht530_oa_tag(u32 hash){   /// low hash bits; the home bucket comes from the top ones
+   return 0x80 | (hash & 0x7f);
+}
+
+static inline u64 ht530_oa_pack(int key, int data){
+   return (u32)key | (u64)(u32)data << 32;
+}
+
+
+static struct ht530_oa_table *ht530_oa_table_alloc(unsigned int new_bits){
+   struct ht530_oa_table *oa;
+
+   oa = kzalloc(sizeof(*oa), GFP_KERNEL_ACCOUNT);
+   if (!oa)
+      return NULL;
+   // power-of-two sized, so cache-line aligned whether it comes from kmalloc or vmalloc
+   oa->buckets = kvzalloc(sizeof(*oa->buckets) << new_bits, GFP_KERNEL_ACCOUNT);
+   oa->locks = ht530_locks_alloc(new_bits, &oa->lock_mask);
+   if (!oa->buckets || !oa->locks) {
+      kvfree(oa->buckets);
+      kvfree(oa->locks);
+      kfree(oa);
+      return NULL;
+   }
+   oa->nbits = new_bits;
+   get_random_bytes(&oa->key, sizeof(oa->key));
+   return oa;
+}
+
+static void ht530_oa_table_free(struct ht530_oa_table *oa){
+   kvfree(oa->locks);
+   kvfree(oa->buckets);
+   kfree(oa);
+}
+
+/// Find key's slot: true with its bucket, slot and slot word. Lock-free; caller keeps oa alive.
+static bool ht530_oa_find(const struct ht530_oa_table *oa, u32 hash, int key, unsigned int *bkt,
+                          unsigned int *slot, u64 *kv){
+   const struct ht530_oa_bucket *bk;
+   unsigned int mask = (1U << oa->nbits) - 1, b = ht530_oa_home(oa, hash), probes, i;
+   u8 tag = ht530_oa_tag(hash);
+   u64 ctrl, m, v;
+
+   for (probes = 0; probes <= mask; probes++, b = (b + 1) & mask) {
+      bk = &oa->buckets[b];
+      ctrl = smp_load_acquire(&bk->ctrl);   // a tag is published after its slot is written
+      for (m = ht530_oa_match(ctrl, tag); m; m &= m - 1) {
+         i = __ffs64(m) >> 3;
+         v = READ_ONCE(bk->slot[i]);
+         if ((u32)v == (u32)key) {
+            *bkt = b;
+            *slot = i;
+            *kv = v;
+            return true;
+         }
+      }
+      if (!(ctrl >> oa_ovf_shift))   // no key probed past this bucket
+         break;
+   }
+   return false;
+}
+
+static void ht530_oa_set_tag(struct ht530_oa_bucket *bk, unsigned int i, u8 tag){   /// other writers may be changing the other bytes
+   u64 old = READ_ONCE(bk->ctrl), prev;
+
+   for (;;) {
+      prev = cmpxchg64(&bk->ctrl, old, (old & ~(0xffULL << (8 * i))) | ((u64)tag << (8 * i)));
+      if (prev == old)
+         return;
+      old = prev;
+   }
+}
+
+static bool ht530_oa_claim(struct ht530_oa_bucket *bk, unsigned int *slot){   /// reserve a free slot, false if bk is full
+   u64 old = READ_ONCE(bk->ctrl), prev, free;
+
+   for (;;) {
+      free = ht530_oa_match(old, 0);
+      if (!free)
+         return false;
+      *slot = __ffs64(free) >> 3;
+      prev = cmpxchg64(&bk->ctrl, old, old | ((u64)oa_reserved << (8 * *slot)));
+      if (prev == old)
+         return true;
+      old = prev;
+   }
+}
+
+/// Count a key homed at from and stored at to in (or take it out of) the buckets it probed past.
+static void ht530_oa_overflow(struct ht530_oa_table *oa, unsigned int from, unsigned int to, bool inc){
+   unsigned int mask = (1U << oa->nbits) - 1, b;
+   u64 *ctrl, old, prev;
+
+   for (b = from; b != to; b = (b + 1) & mask) {
+      ctrl = &oa->buckets[b].ctrl;
+      old = READ_ONCE(*ctrl);
+      while ((old >> oa_ovf_shift) != 0xff) {   // a saturated count stays put
+         prev = cmpxchg64(ctrl, old, inc ? old + (1ULL << oa_ovf_shift) : old - (1ULL << oa_ovf_shift));
+         if (prev == old)
+            break;
+         old = prev;
+      }
+   }
+}
+
+/*
+ * Store a key that isn't in oa. Caller holds its home bucket's stripe (or has oa to itself). Returns
+ * how many buckets past its home the key went, or -ENOSPC.
+ */
+static int ht530_oa_insert(struct ht530_oa_table *oa, u32 hash, u64 kv){
+   struct ht530_oa_bucket *bk;
+   unsigned int mask = (1U << oa->nbits) - 1, home = ht530_oa_home(oa, hash), b = home, probes, i;
+
+   for (probes = 0; probes <= mask; probes++, b = (b + 1) & mask) {
+      bk = &oa->buckets[b];
+      if (!ht530_oa_claim(bk, &i))
+         continue;
+      WRITE_ONCE(bk->slot[i], kv);
+      ht530_oa_overflow(oa, home, b, true);          // before the tag, so no lookup stops short of it
+      ht530_oa_set_tag(bk, i, ht530_oa_tag(hash));   // cmpxchg orders the slot store before the tag
+      return probes;
+   }
+   return -ENOSPC;   // every slot taken: the table is at max_bits, or the grow hasn't run yet
+}
+
+static void ht530_oa_remove(struct ht530_oa_table *oa, u32 hash, unsigned int b, unsigned int i){   /// free slot i of bucket b
+   ht530_oa_set_tag(&oa->buckets[b], i, 0);   // gone for lookups from here on
+   ht530_oa_overflow(oa, ht530_oa_home(oa, hash), b, false);
+}
+
+static unsigned int ht530_oa_wanted_bits(struct ht530_table *t, unsigned int cur, s64 nelems){   /// bucket count the fill level calls for
+   u64 slots = (u64)oa_slots << cur;
+
+   if ((u64)nelems * 100 > slots * oa_max_fill && cur < t->max_bits)
+      return cur + 1;
+   if ((u64)nelems * 100 < slots * oa_min_fill && cur > t->init_bits && !atomic_read(&t->loads))
+      return cur - 1;
+   return cur;
+}
+
+static void ht530_oa_resize_check(struct ht530_table *t, struct ht530_oa_table *oa){
+   if (ht530_oa_wanted_bits(t, oa->nbits, percpu_counter_read_positive(&t->nelems)) != oa->nbits)
+      schedule_work(&t->resize_work);
+}
+
+/// After an insert that probed past probes buckets: the chained table's chain_max check, in slots.
+static void ht530_oa_probe_check(struct ht530_table *t, struct ht530_oa_table *oa, unsigned int probes){
+   unsigned int limit = READ_ONCE(t->chain_max);
+   s64 nelems;
+   u64 slots, tail;
+
+   if (!limit || probes * oa_slots <= limit || READ_ONCE(t->reseed))
+      return;
+   nelems = percpu_counter_read_positive(&t->nelems);
+   // past oa_max_fill every probe sequence is long, and the grow that is due rehashes anyway
+   if (ht530_oa_wanted_bits(t, oa->nbits, nelems) > oa->nbits)
+      return;
+   // random keys at fill f land up to about 1/(1-f)^2 buckets past home (25 at 80%), more under
+   // churn, so only an insert several times past that says the hash is being gamed
+   slots = (u64)oa_slots << oa->nbits;
+   tail = div64_u64(slots << 4, slots - min_t(u64, nelems, slots - 1));   // 16/(1-f)
+   if (probes <= limit / oa_slots + tail * tail / 64)
+      return;
+   WRITE_ONCE(t->reseed, true);   // the rebuild at the same size comes with a new key
+   schedule_work(&t->resize_work);
+}
+
+/// Lock the stripe of key's home bucket, setting *hash to its hash in the oa returned.
+/// Adds the ns waited for it to *wait while profiling.
+static struct ht530_oa_table *ht530_oa_write_lock(struct ht530_table *t, int key, u32 *hash, spinlock_t **lock,
+                                                  u64 *wait){
+   struct ht530_oa_table *oa;
+   u64 waited;
+
+   percpu_down_read(&t->oa_rwsem);
+   oa = rcu_dereference_protected(t->oa, 1);   // only a resize changes it, and that needs oa_rwsem
+   *hash = ht530_hash(&oa->key, &key, sizeof(key));
+   *lock = &oa->locks[ht530_oa_home(oa, *hash) & oa->lock_mask].lock;
+   waited = ht530_lock_stripe(t, *lock, 0);
+   if (unlikely(waited)) {
+      *wait += waited;
+      ht530_hot_note(t, hot_contended, &key, sizeof(key));
+   }
+   return oa;
+}
+
+static void ht530_oa_write_unlock(struct ht530_table *t, spinlock_t *lock){
+   spin_unlock(lock);
+   percpu_up_read(&t->oa_rwsem);
+}
+
+static bool ht530_oa_get(struct ht530_table *t, int key, int *data){   /// as ht530_get
+   struct ht530_oa_table *oa;
+   unsigned int b, i;
+   u64 kv, start = ht530_lat_start();
+   bool found;
+
+   rcu_read_lock();
+   oa = rcu_dereference(t->oa);
+   found = ht530_oa_find(oa, ht530_hash(&oa->key, &key, sizeof(key)), key, &b, &i, &kv);
+   rcu_read_unlock();
+   ht530_stat_inc(t, gets);
+   if (found) {
+      *data = (int)(kv >> 32);
+      ht530_stat_inc(t, hits);
+      trace_ht530_hit(t->id, &key, sizeof(key), sizeof(int));
+   } else {
+      ht530_stat_inc(t, misses);
+      trace_ht530_miss(t->id, &key, sizeof(key));
+   }
+   if (start) {
+      ht530_hot_sample(t, &key, sizeof(key));
+      ht530_lat_end(t, lat_get, start, 0);
+   }
+   return found;
+}
+
+/// An insert found no free slot below max_bits: the inserts outran the resize work, wait for the grow.
+static void ht530_oa_wait_grow(struct ht530_table *t){
+   schedule_work(&t->resize_work);
+   flush_work(&t->resize_work);
+}
+
+static int ht530_oa_put(struct ht530_table *t, int key, int data){   /// 1 replaced, 0 inserted, -ENOSPC
+   struct ht530_oa_table *oa;
+   spinlock_t *lock;
+   unsigned int b, i;
+   u32 hash;
+   u64 kv, start = ht530_lat_start(), wait = 0;
+   int ret;
+   bool full;
+
+   for (;;) {
+      oa = ht530_oa_write_lock(t, key, &hash, &lock, &wait);
+      if (ht530_oa_find(oa, hash, key, &b, &i, &kv)) {
+         WRITE_ONCE(oa->buckets[b].slot[i], ht530_oa_pack(key, data));
+         ht530_changed_int(t, HT530_CHANGE_REPLACE, key, data);
+         ht530_stat_inc(t, replaces);
+         trace_ht530_replace(t->id, &key, sizeof(key), sizeof(int));
+         ret = 1;
+      } else {
+         ret = ht530_oa_insert(oa, hash, ht530_oa_pack(key, data));
+         if (ret >= 0) {
+            ht530_oa_probe_check(t, oa, ret);
+            ret = 0;
+            ht530_changed_int(t, HT530_CHANGE_INSERT, key, data);
+            percpu_counter_inc(&t->nelems);
+            ht530_stat_inc(t, inserts);
+            trace_ht530_insert(t->id, &key, sizeof(key), sizeof(int));
+            ht530_oa_resize_check(t, oa);
+         }
+      }
+      full = ret == -ENOSPC && oa->nbits < t->max_bits;
+      ht530_oa_write_unlock(t, lock);
+      if (!full)
+         break;
+      ht530_oa_wait_grow(t);
+   }
+   if (start) {
+      ht530_hot_sample(t, &key, sizeof(key));
+      ht530_lat_end(t, lat_put, start, wait);
+   }
+   return ret;
+}
+
+static bool ht530_oa_del(struct ht530_table *t, int key, int *data){   /// as ht530_del
+   struct ht530_oa_table *oa;
+   spinlock_t *lock;
+   unsigned int b, i;
+   u32 hash;
+   u64 kv, start = ht530_lat_start(), wait = 0;
+   bool found;
+
+   oa = ht530_oa_write_lock(t, key, &hash, &lock, &wait);
+   found = ht530_oa_find(oa, hash, key, &b, &i, &kv);
+   if (found) {
+      ht530_oa_remove(oa, hash, b, i);
+      ht530_changed_int(t, HT530_CHANGE_DELETE, key, 0);
+      percpu_counter_dec(&t->nelems);
+      ht530_oa_resize_check(t, oa);
+   }
+   ht530_oa_write_unlock(t, lock);
+   *data = found ? (int)(kv >> 32) : 0;
+   if (found) {
+      ht530_stat_inc(t, deletes);
+      trace_ht530_delete(t->id, &key, sizeof(key), sizeof(int));
+   }
+   if (start) {
+      ht530_hot_sample(t, &key, sizeof(key));
+      ht530_lat_end(t, lat_del, start, wait);
+   }
+   return found;
+}
+
+static int ht530_oa_rmw(struct ht530_table *t, u32 op, int key, int data, int expected, int *old){   /// as ht530_rmw
+   struct ht530_oa_table *oa;
+   spinlock_t *lock;
+   unsigned int b, i;
+   u32 hash;
+   u64 kv, wait = 0;   // RMW isn't timed, its contention still feeds the hot keys
+   bool found, full;
+   int ret;
+
+   for (;;) {
+      oa = ht530_oa_write_lock(t, key, &hash, &lock, &wait);
+      found = ht530_oa_find(oa, hash, key, &b, &i, &kv);
+      *old = found ? (int)(kv >> 32) : 0;
+      switch (op) {
+      case HT530_OP_CAS:
+         ret = !found ? -ENOENT : *old != expected ? -EAGAIN : 0;
+         if (!ret)
+            WRITE_ONCE(oa->buckets[b].slot[i], ht530_oa_pack(key, data));
+         break;
+      case HT530_OP_FETCH_ADD:
+         if (found)
+            WRITE_ONCE(oa->buckets[b].slot[i], ht530_oa_pack(key, (int)((u32)*old + (u32)data)));
+         ret = found ? 1 : 0;
+         break;
+      case HT530_OP_INSERT:
+         ret = found ? -EEXIST : 0;
+         break;
+      default:
+         ret = -EINVAL;
+      }
+      if (!found && !ret && op != HT530_OP_CAS) {
+         ret = ht530_oa_insert(oa, hash, ht530_oa_pack(key, data));
+         if (ret >= 0) {
+            ht530_oa_probe_check(t, oa, ret);
+            ret = 0;
+            ht530_changed_int(t, HT530_CHANGE_INSERT, key, data);
+            percpu_counter_inc(&t->nelems);
+            ht530_stat_inc(t, inserts);
+            trace_ht530_insert(t->id, &key, sizeof(key), sizeof(int));
+            ht530_oa_resize_check(t, oa);
+         }
+      } else if (ret >= 0) {
+         ht530_changed_int(t, HT530_CHANGE_REPLACE, key, (int)(READ_ONCE(oa->buckets[b].slot[i]) >> 32));
+         ht530_stat_inc(t, replaces);
+         trace_ht530_replace(t->id, &key, sizeof(key), sizeof(int));
+      }
+      full = ret == -ENOSPC && oa->nbits < t->max_bits;
+      ht530_oa_write_unlock(t, lock);
+      if (!full)
+         return ret;
+      ht530_oa_wait_grow(t);
+   }
+}
+
+/// DUMP: remove the keys whose home is bucket n, returning up to 8 of them. -EINVAL if n is out of range.
+static int ht530_oa_dump(struct ht530_table *t, int n, struct ht *out){
+   struct ht530_oa_table *oa;
+   struct ht530_oa_bucket *bk;
+   spinlock_t *lock;
+   unsigned int mask, b, probes, i, got = 0;
+   u64 ctrl, kv;
+   u32 hash;
+   int key;
+
+   percpu_down_read(&t->oa_rwsem);
+   oa = rcu_dereference_protected(t->oa, 1);
+   mask = (1U << oa->nbits) - 1;
+   if (n < 0 || n > mask) {
+      percpu_up_read(&t->oa_rwsem);
+      return -EINVAL;
+   }
+   lock = &oa->locks[n & oa->lock_mask].lock;   // every writer of a key homed at n takes it
+   ht530_lock_stripe(t, lock, 0);
+   for (probes = 0, b = n; probes <= mask; probes++, b = (b + 1) & mask) {
+      bk = &oa->buckets[b];
+      ctrl = READ_ONCE(bk->ctrl);
+      for (i = 0; i < oa_slots; i++) {
+         if (!((ctrl >> (8 * i)) & 0x80))   // free, or being filled in for some other home
+            continue;
+         kv = READ_ONCE(bk->slot[i]);
+         key = (int)(u32)kv;
+         hash = ht530_hash(&oa->key, &key, sizeof(key));
+         if (ht530_oa_home(oa, hash) != n)
+            continue;
+         ht530_oa_remove(oa, hash, b, i);
+         ht530_changed_int(t, HT530_CHANGE_DELETE, key, 0);
+         percpu_counter_dec(&t->nelems);
+         ht530_stat_inc(t, dumps);
+         trace_ht530_dump(t->id, n, key, (int)(kv >> 32));
+         if (got < 8) {
+            out[got].key = key;
+            out[got].data = (int)(kv >> 32);
+            got++;
+         }
+      }
+      if (!(ctrl >> oa_ovf_shift))   // as in ht530_oa_find: nothing from n lies further on
+         break;
+   }
+   spin_unlock(lock);
+   ht530_oa_resize_check(t, oa);
+   percpu_up_read(&t->oa_rwsem);
+   return got;
+}
+
+/// Rebuild at 2^new_bits buckets under resize_mutex; reseed only says why, every rebuild gets a new key.
+static int ht530_oa_rehash(struct ht530_table *t, unsigned int new_bits, bool reseed){
+   struct ht530_oa_table *old, *new;
+   struct ht530_oa_bucket *bk;
+   unsigned int b, i, obits;
+   u64 kv;
+   int key, ret = 0;
+
+   new = ht530_oa_table_alloc(new_bits);
+   if (!new) {
+      printk(KERN_WARNING "ht530: no memory to resize table %u to %u buckets\n", t->id, 1U << new_bits);
+      return -ENOMEM;
+   }
+   if (reseed) {
+      WRITE_ONCE(t->reseed, false);
+      ht530_stat_inc(t, reseeds);
+      printk(KERN_WARNING "ht530: table %u has a probe sequence over chain_max, rehashing under a new hash key\n", t->id);
+   }
+   percpu_down_write(&t->oa_rwsem);   // waits for the writers; readers carry on in old
+   old = rcu_dereference_protected(t->oa, 1);
+   obits = old->nbits;
+   for (b = 0; b < (1U << obits) && ret >= 0; b++) {
+      bk = &old->buckets[b];
+      for (i = 0; i < oa_slots && ret >= 0; i++) {
+         if (!((bk->ctrl >> (8 * i)) & 0x80))
+            continue;
+         kv = bk->slot[i];
+         key = (int)(u32)kv;
+         ret = ht530_oa_insert(new, ht530_hash(&new->key, &key, sizeof(key)), kv);
+      }
+      if ((b & 255) == 255)
+         cond_resched();
+   }
+   if (ret < 0) {   // can't happen at the fill levels we resize to, but don't lose keys if it does
+      percpu_up_write(&t->oa_rwsem);
+      ht530_oa_table_free(new);
+      return ret;
+   }
+   rcu_assign_pointer(t->oa, new);
+   percpu_up_write(&t->oa_rwsem);
+   synchronize_rcu();
+   ht530_oa_table_free(old);
+   printk(KERN_INFO "ht530: table %u resized from %u to %u buckets\n", t->id, 1U << obits, 1U << new_bits);
+   return 0;
+}
+
+static void ht530_oa_resize_work(struct work_struct *work){
+   struct ht530_table *t = container_of(work, struct ht530_table, resize_work);
+   unsigned int cur, new_bits;
+   bool reseed;
+
+   mutex_lock(&t->resize_mutex);
+   memalloc_use_memcg(t->memcg);
+   for (;;) {
+      cur = rcu_dereference_protected(t->oa, lockdep_is_held(&t->resize_mutex))->nbits;
+      new_bits = ht530_oa_wanted_bits(t, cur, percpu_counter_sum_positive(&t->nelems));
+      reseed = READ_ONCE(t->reseed);
+      if ((new_bits == cur && !reseed) || ht530_oa_rehash(t, new_bits, reseed))
+         break;
+   }
+   memalloc_unuse_memcg();
+   mutex_unlock(&t->resize_mutex);
+}
+
+/*
+ * The int interfaces (read/write, batch, rings): an int key or value is a 4-byte one. Lookups only
+ * report entries whose value is 4 bytes too.
+ */
+bool ht530_get(struct ht530_table *t, int key, int *data){   /// lock-free lookup, true if key is present
+   int val;
+
+   if (t->open)
+      return ht530_oa_get(t, key, data);
+   if (ht530_kv_get(t, &key, sizeof(key), &val, sizeof(val)) != sizeof(val))
+      return false;
+   *data = val;
+   return true;
+}
+
+/// Insert or replace key; *spare comes from ht530_entry_alloc_int() and is consumed as in ht530_kv_put.
+/// The open-addressing backend never consumes it and may also fail with -ENOSPC.
+int ht530_put(struct ht530_table *t, int key, int data, struct ht_entry **spare){
+   if (t->open)
+      return ht530_oa_put(t, key, data);   // no entries to allocate, *spare is left alone
+   memcpy((*spare)->key, &key, sizeof(key));
+   memcpy((*spare)->val, &data, sizeof(data));
+   (*spare)->expires = ht530_expiry(READ_ONCE(t->default_ttl_ms));
+   return ht530_kv_put(t, spare);
+}
+
+bool ht530_del(struct ht530_table *t, int key, int *data){   /// remove key, true (and its old data) if it was present
+   int val = 0, ret;
+
+   if (t->open)
+      return ht530_oa_del(t, key, data);
+   ret = ht530_kv_del(t, &key, sizeof(key), &val, sizeof(val));
+   *data = ret == sizeof(val) ? val : 0;   // a non-int value has no int to report
+   return ret >= 0;
+}
+
+/*
+ * Read-modify-write on an int key in one step (HT530_RMW, and the FETCH_ADD / INSERT ops of batches
+ * and rings). The whole op runs under the key's bucket lock and changes the value with an in-place
+ * WRITE_ONCE, so lock-free readers see the int before or after it, never a mix. *old gets the value
+ * found, 0 if there was none. FETCH_ADD and INSERT may insert and then consume *spare (from
+ * ht530_entry_alloc_int()) as ht530_kv_put does; CAS never inserts and needs no spare.
+ * Returns 0 or 1 as described for HT530_RMW, or a negative errno.
+ */
+int ht530_rmw(struct ht530_table *t, u32 op, int key, int data, int expected, int *old,
+                     struct ht_entry **spare){
+   struct ht530_wlock w;
+   struct ht_entry *e, *n;
+   unsigned long expires = ht530_expiry(READ_ONCE(t->default_ttl_ms));
+   bool inserted;
+   int ret;
+
+   if (t->open)
+      return ht530_oa_rmw(t, op, key, data, expected, old);
+   if (expires && op != HT530_OP_CAS)
+      ht530_reap_start(t);
+   *old = 0;
+   ht530_write_lock(t, &w, &key, sizeof(key));
+   e = ht530_write_find(&w, &key, sizeof(key));
+   if (e && ht530_expired(e)) {
+      ht530_stat_inc(t, expired);
+      ht530_write_unlink(&w, e);
+      e = NULL;
+   }
+   if (e && e->vlen != sizeof(int)) {   // the key holds a byte string, not an int
+      ht530_write_unlock(&w);
+      return op == HT530_OP_INSERT ? -EEXIST : -EINVAL;
+   }
+   if (e) {
+      *old = ht530_entry_int_data(e);
+      if (!READ_ONCE(e->ref))
+         WRITE_ONCE(e->ref, 1);
+   }
+
+   switch (op) {
+   case HT530_OP_CAS:
+      if (!e) {
+         ret = -ENOENT;
+      } else if (*old != expected) {
+         ret = -EAGAIN;
+      } else {
+         WRITE_ONCE(*(int *)e->val, data);
+         ret = 0;
+      }
+      break;
+   case HT530_OP_FETCH_ADD:
+      if (e)
+         WRITE_ONCE(*(int *)e->val, (int)((u32)*old + (u32)data));   // wraps around instead of overflowing
+      ret = e ? 1 : 0;   // an absent counter counts from 0, i.e. gets inserted as data
+      break;
+   case HT530_OP_INSERT:
+      ret = e ? -EEXIST : 0;
+      break;
+   default:
+      ret = -EINVAL;
+   }
+
+   inserted = !e && ret == 0 && op != HT530_OP_CAS;
+   if (inserted) {
+      n = *spare;
+      *spare = NULL;
+      memcpy(n->key, &key, sizeof(key));
+      memcpy(n->val, &data, sizeof(data));
+      n->ref = 1;
+      n->expires = expires;
+      n->linked[0] = n->linked[1] = 0;
+      ht530_write_link(&w, n);
+      ht530_stat_inc(t, inserts);
+      trace_ht530_insert(t->id, &key, sizeof(key), sizeof(int));
+   } else if (ret >= 0) {   // CAS swapped or FETCH_ADD added in place
+      ht530_changed_entry(t, HT530_CHANGE_REPLACE, e);
+      ht530_stat_inc(t, replaces);
+      trace_ht530_replace(t->id, &key, sizeof(key), sizeof(int));
+   }
+   ht530_write_unlock(&w);
+   if (inserted)
+      ht530_enforce_budget(t);
+   return ret;
+}
+
+
+/*
+ * Table lifecycle, the memory half of it: ht530_dev.c gives a new table its id, node and debugfs
+ * directory, and frees it once the last fd that had it open is closed.
+ */
+void ht530_table_free(struct ht530_table *t){   /// nobody can reach t any more
+   struct ht530_bucket_table *tbl;
+   struct ht_entry * curr;
+   struct hlist_node * n, * tmp;
+   unsigned int bkt;
+
+   if (t->cache) {   // waits out a shrinker scan that may be sweeping t
+      mutex_lock(&ht530_cache_lock);
+      list_del(&t->cache_node);
+      mutex_unlock(&ht530_cache_lock);
+   }
+   cancel_delayed_work_sync(&t->reap_work);
+   cancel_work_sync(&t->resize_work);   // no resize can be running or queued past this point (the reaper may have queued one)
+   tbl = rcu_dereference_protected(t->tbl, 1);
+   if (tbl) {
+      //Deleting the FULL Hash Table
+      for (bkt = 0; bkt < (1U << tbl->nbits); bkt++){
+         for (n = tbl->buckets[bkt].first; n; n = tmp){
+            tmp = n->next;
+            curr = ht530_node_entry(n, tbl->gen);
+            ht530_dbg("DELETE table %u klen=[%u]  vlen=[%u] is in bucket\n", t->id, curr->klen , curr->vlen);
+            ht530_entry_free(curr);
+         }
+      }
+      ht530_bucket_table_free(tbl);
+   }
+   if (t->open) {
+      if (rcu_access_pointer(t->oa))
+         ht530_oa_table_free(rcu_dereference_protected(t->oa, 1));
+      percpu_free_rwsem(&t->oa_rwsem);
+   }
+   kvfree(t->bloom);
+   vfree(t->view);
+   kfree(t->hot);
+   free_percpu(t->lat);
+   free_percpu(t->stats);
+   percpu_counter_destroy(&t->mem);
+   percpu_counter_destroy(&t->nelems);
+   mem_cgroup_put(t->memcg);
+   kfree(t);
+}
+
+/// Allocate an empty table as info describes; a 0 field means the module parameter's value.
+struct ht530_table *ht530_table_new(const struct ht530_table_info *info){
+   struct ht530_table *t;
+   unsigned int i, vbits;
+
+   if ((info->flags & ~(HT530_TABLE_ORDERED | HT530_TABLE_CACHE)) ||
+       ((info->flags & (HT530_TABLE_ORDERED | HT530_TABLE_CACHE)) && ht530_open_backend))
+      return ERR_PTR(-EINVAL);   // open-addressing buckets hold no entries to index or evict
+   t = kzalloc(sizeof(*t), GFP_KERNEL_ACCOUNT);
+   if (!t)
+      return ERR_PTR(-ENOMEM);
+   if (percpu_counter_init(&t->nelems, 0, GFP_KERNEL)){
+      kfree(t);
+      return ERR_PTR(-ENOMEM);
+   }
+   if (percpu_counter_init(&t->mem, 0, GFP_KERNEL)){
+      percpu_counter_destroy(&t->nelems);
+      kfree(t);
+      return ERR_PTR(-ENOMEM);
+   }
+   t->open = ht530_open_backend;
+   t->ordered = info->flags & HT530_TABLE_ORDERED;
+   spin_lock_init(&t->index_lock);
+   t->index = RB_ROOT;
+   spin_lock_init(&t->watch_lock);
+   INIT_LIST_HEAD(&t->watchers);
+   if (t->open && percpu_init_rwsem(&t->oa_rwsem)){
+      percpu_counter_destroy(&t->mem);
+      percpu_counter_destroy(&t->nelems);
+      kfree(t);
+      return ERR_PTR(-ENOMEM);
+   }
+   t->chain_max = chain_max;
+   t->max_bits = clamp_t(unsigned int, info->max_bits ? info->max_bits : max_bits, 1, 30);
+   t->init_bits = clamp_t(unsigned int, info->init_bits ? info->init_bits : init_bits, 1, t->max_bits);
+   t->max_entries = info->max_entries ? info->max_entries : max_entries;
+   t->max_bytes = info->max_bytes ? info->max_bytes : max_bytes;
+   t->default_ttl_ms = info->ttl_ms ? info->ttl_ms : default_ttl_ms;
+   mutex_init(&t->resize_mutex);
+   INIT_WORK(&t->resize_work, t->open ? ht530_oa_resize_work : ht530_resize_work);
+   INIT_DELAYED_WORK(&t->reap_work, ht530_reap_work);
+   kref_init(&t->ref);
+   t->memcg = get_mem_cgroup_from_mm(current->mm);   // NULL for kernel threads and without memcg
+   t->stats = alloc_percpu(struct ht530_stats);
+   t->lat = alloc_percpu(struct ht530_lat);
+   t->hot = kcalloc(2, sizeof(*t->hot), GFP_KERNEL_ACCOUNT);
+   if (t->hot) {
+      for (i = 0; i < 2; i++) {
+         spin_lock_init(&t->hot[i].lock);
+         get_random_bytes(&t->hot[i].hkey, sizeof(t->hot[i].hkey));
+      }
+   }
+   if (t->open)
+      RCU_INIT_POINTER(t->oa, ht530_oa_table_alloc(t->init_bits));
+   else
+      RCU_INIT_POINTER(t->tbl, ht530_bucket_table_alloc(t->init_bits, 0));
+   t->bloom_bits = READ_ONCE(bloom_bits);
+   if (t->bloom_bits && !t->open) {   // open addressing misses read a cache line or two already
+      t->bloom_bits = clamp_t(unsigned int, t->bloom_bits, 10, 30);
+      t->bloom = kvzalloc(1UL << t->bloom_bits, GFP_KERNEL_ACCOUNT);   // power-of-two sized, so block aligned
+      get_random_bytes(&t->bloom_key, sizeof(t->bloom_key));
+   }
+   vbits = READ_ONCE(view_bits);
+   if (vbits) {
+      vbits = clamp_t(unsigned int, vbits, 4, 24);
+      t->view_size = PAGE_ALIGN(HT530_VIEW_HDR_SIZE + (sizeof(*t->view_lines) << vbits));
+      t->view = vmalloc_user(t->view_size);   // zeroed, and allowed to be mapped into userspace
+   }
+   if (t->view) {
+      t->view->magic = HT530_VIEW_MAGIC;
+      t->view->nbits = vbits;
+      t->view->map_size = t->view_size;
+      t->view->lines_off = HT530_VIEW_HDR_SIZE;
+      get_random_bytes(&t->view->seed, sizeof(t->view->seed));
+      get_random_bytes(&t->view->mul, sizeof(t->view->mul));
+      t->view->mul |= 1;   // odd, so the multiply loses no key bits
+      t->view_lines = (void *)t->view + HT530_VIEW_HDR_SIZE;
+   }
+   if (!t->stats || !t->lat || !t->hot || (t->open ? !rcu_access_pointer(t->oa) : !rcu_access_pointer(t->tbl)) ||
+       (t->bloom_bits && !t->open && !t->bloom) || (t->view_size && !t->view)){
+      ht530_table_free(t);
+      return ERR_PTR(-ENOMEM);
+   }
+   if (info->flags & HT530_TABLE_CACHE) {
+      t->cache = true;
+      t->reclaim_stamp = jiffies;
+      mutex_lock(&ht530_cache_lock);
+      list_add_tail(&t->cache_node, &ht530_cache_tables);
+      mutex_unlock(&ht530_cache_lock);
+   }
+   return t;
+}
+
+int ht530_core_init(void){   /// check the parameters, create the entry caches
+   max_bits = clamp_t(unsigned int, max_bits, 1, 30);
+   init_bits = clamp_t(unsigned int, init_bits, 1, max_bits);
+   hot_sample = hot_sample ? roundup_pow_of_two(hot_sample) : 1;
+   if (!strcmp(backend, "open") && IS_ENABLED(CONFIG_64BIT)){   // a slot is read and written as one 64-bit word
+      ht530_open_backend = true;
+   } else if (strcmp(backend, "chain")){
+      printk(KERN_ALERT "ht530: unknown or unsupported backend %s\n", backend);
+      return -EINVAL;
+   }
+   if (ht530_entry_cache_create())
+      return -ENOMEM;
+   if (register_shrinker(&ht530_shrinker)) {
+      ht530_entry_cache_destroy();
+      return -ENOMEM;
+   }
+   return 0;
+}
+
+void ht530_core_exit(void){   /// every table is freed
+   unregister_shrinker(&ht530_shrinker);
+   rcu_barrier();   // let pending call_rcu frees finish before the module text goes away
+   ht530_entry_cache_destroy();   // everything is back in the cache, it must be empty now
+}
+
+static const char ht530_not_found[sizeof(struct dump_arg)] = "-1";   /// "-1", padded to the records it is copied out in place of
+
+/// read(): look up the key of the struct ht at buffer and write the pair (or "-1") back over it
+ssize_t ht530_table_read(struct ht530_table *table, char __user *buffer){
+   int error_count = 0;
+   char* msg;
+
+   struct ht ht_msg;
+   struct ht req;   // per-call copy of the request, nothing is shared between concurrent callers
+
+   // Get and Cast back ht struct from buffer pntr
+   if (copy_from_user(&req, buffer, sizeof(struct ht)))
+      return -EFAULT;
+   struct ht* t = &req;
+   ht530_dbg("This is the key to search: [%d]\n", t->key );
+
+   // Search hash table by key of passed ht pntr, without taking any lock
+   ht_msg.key = t->key;
+   bool chk_fnd = ht530_get(table, t->key, &ht_msg.data);
+   if(chk_fnd)
+      ht530_dbg("FOUND-SRCH ht530_tbl key=[%d]  data=[%d] is in bucket\n", ht_msg.key , ht_msg.data);
+   if(chk_fnd == 0){
+      msg = (char*)ht530_not_found;
+   } else {
+   // cast found ht object
+   msg = (char*) &ht_msg;
+   }
+
+  
+   error_count = copy_to_user(buffer, msg, sizeof(struct ht)); // copy back the result in the same ht struct pointed by buffer
+
+   if (error_count==0){            // if true then have success
+      ht530_dbg("Sent %ld characters to the user\n", sizeof(struct ht));
+      if( chk_fnd == 0){return EINVAL;} // return EINVAL if not found
+      return 0;
+
+   }
+   else {
+      ht530_dbg("Failed to send %d characters to the user\n", error_count);
+      return -EFAULT;              // Failed -- return a bad address message (i.e. -14)
+   }
+}
+
+
+
+
+/// write(): put the struct ht at buffer, or delete its key if data is 0
+ssize_t ht530_table_write(struct ht530_table *table, const char __user *buffer, size_t len){
+   struct ht req;   // per-call copy of the request, nothing is shared between concurrent callers
+   if (copy_from_user(&req, buffer, sizeof(struct ht)))
+      return -EFAULT;
+   struct ht* hep = &req;
+
+   
+   ht530_dbg("Received key: %d data: %d from the user\n", hep->key, hep->data );
+   
+
+
+   int old_data;
+
+
+   if(hep->data == 0){ // Zero data filed means to delete corresponding entry with the supplied key
+      if(ht530_del(table, hep->key, &old_data))
+      ht530_dbg("DELETE key=[%d]  data=[%d]  \n", hep->key , old_data);
+
+   } else { //Non-Zero Data Field
+      // Allocate up front: the allocation may sleep, so it can't run under the bucket lock
+      struct ht_entry * hte = NULL;
+      int ret;
+      if (!table->open){   // the open-addressing backend stores ints in its buckets
+         hte = ht530_entry_alloc_int(table);
+         if (!hte)
+            return -ENOMEM;
+      }
+
+      // If there exist any entry with the same key than data is replaced,
+      // else the new entry is chained to one of the hash table bucket acc. to the key
+      ret = ht530_put(table, hep->key, hep->data, &hte);
+      if (hte)
+         ht530_entry_free(hte);   // value stored in place, the spare entry isn't needed
+      if (ret < 0)
+         return ret;   // open addressing: every slot is taken
+      if(ret){
+         ht530_dbg("REPLACE ht530_tbl key=[%d]  data=[%d] \n", hep->key , hep->data);
+      } else {
+         ht530_dbg("ADD ht530_tbl key=[%d]  data=[%d] \n", hep->key , hep->data);
+      }
+
+   }
+
+   /// Just print check functions
+   // hash_for_each(ht530_tbl, bkt, curr,  node){
+   //    printk(KERN_INFO "ht530: AFTER_wr_ops ht530_tbl key=[%d]  data=[%d] is in bucket=[%d]\n", curr->key , curr->data, bkt);
+   // }
+   
+   return len;
+}
+
+
+
+
+
+
+
+static long ht530_ioctl_dump(struct ht530_table *t, unsigned int ioctl_num, unsigned long ioctl_param){   /// DUMP: drain one bucket, return up to 8 of its entries
+   int error_count=0;
+   char* mp = (char*)ioctl_param;   // Casting to char* for read
+   struct dump_arg arg;   // per-call copy of the request
+   if (copy_from_user(&arg, mp, sizeof(struct dump_arg)))  // read from user space
+      return -EFAULT;
+   struct dump_arg* db = &arg;
+
+   struct ht_entry * curr;
+   struct hlist_node * n;
+   struct ht530_wlock w;
+   char* pdb;
+   bool out_ran = 0;
+   u64 start = ht530_lat_start(), wait = 0;
+
+   int ind;
+   for( ind=0;ind<8;ind++){   /// setting dump_arf::obj array data,key values to -1 in case less than 8 values are there in a bucket
+      db->object_array[ind].key = -1;
+      db->object_array[ind].data = -1;
+     
+   }
+
+   if( ioctl_num == DUMP){    /// If the provided ioctl num equals to the DUMP cmd num
+      ht530_dbg("IOCTL-DUMP function ioctl_num=[%u]\n", ioctl_num);
+      ht530_dbg("IOCTL-DUMP this bucket n=[%d]\n", db->n);
+
+      int htind = 0;
+      if (t->open){   // keys homed at bucket n, the closest thing to a chain
+         out_ran = ht530_oa_dump(t, db->n, db->object_array) < 0;
+         pdb = out_ran ? (char*)ht530_not_found : (char*)db;
+      } else {
+      // Hold off resizes so bucket n means the same thing for the whole dump
+      mutex_lock(&t->resize_mutex);
+      if (start)
+         wait = ktime_get_ns() - start;
+      w.t = t;
+      w.tbl = rcu_dereference_protected(t->tbl, lockdep_is_held(&t->resize_mutex));
+      w.future = NULL;
+      if(db->n >=0 && db->n < (1 << w.tbl->nbits)){   /// If given bucket no. is within range
+         w.bkt = db->n;
+         wait += ht530_lock_stripe(t, ht530_bucket_lock(w.tbl, w.bkt), 0);
+         ht530_for_each_entry(curr, n, &w.tbl->buckets[w.bkt], w.tbl->gen){       // iterate for the nth bucket
+               if (!ht530_entry_is_int(curr))   // byte-string entries aren't DUMP's to take
+                  continue;
+               ht530_stat_inc(t, dumps);
+               trace_ht530_dump(t->id, db->n, ht530_entry_int_key(curr), ht530_entry_int_data(curr));
+               if(htind <= 7) // If no. of dumps in a bucket are less than 8 in a bucket then add to the return array in dump arg
+                  {
+                     db->object_array[htind].key = ht530_entry_int_key(curr);
+                     db->object_array[htind].data = ht530_entry_int_data(curr);
+                     htind++;
+                  }  
+                  
+               ht530_write_unlink(&w, curr);   // hlist_del_rcu leaves ->next intact, the walk can go on
+               
+        }
+         spin_unlock(ht530_bucket_lock(w.tbl, w.bkt));
+       pdb = (char*)db;    // cast again to char* for writing back to user space
+
+      } else { // n is OUT of range
+       pdb = (char*)ht530_not_found;   
+       out_ran = 1;
+      }
+      mutex_unlock(&t->resize_mutex);
+      }
+      if (start)
+         ht530_lat_end(t, lat_dump, start, wait);
+
+
+   
+   error_count = copy_to_user(mp, pdb, sizeof(struct dump_arg));  // write back to user space dump_arg obj pointed by ioctl_param casted to char* by mp above
+
+
+
+   if (error_count==0){            // if true then have success
+      ht530_dbg("IOCTL-DUMP Copied %ld characters to the user\n", sizeof(struct dump_arg));
+      if(out_ran == 1){return EINVAL;} // return EINVAL incase out n is out of range 
+      return 0;
+   }
+   else {
+      ht530_dbg("IOCTL-DUMP Failed to send %d characters to the user\n", error_count);
+      return -EFAULT;              // Failed -- return a bad address message (i.e. -14)
+   }
+
+         
+   }
+
+
+return 0;
+}
+
+
+
+/*
+ * HT530_EXPORT cursor: the table size and hash-key epoch it was issued for, a bucket and a position in
+ * that bucket's chain (reseeding keeps chains far shorter than 2^24). Buckets are the top bits of the
+ * key hash, so a bucket maps to a contiguous slice of hash space and a cursor can be carried over to a
+ * resized table by rescaling the bucket index; after a reseed the slices mean nothing and the walk
+ * has to start over.
+ */
+#define EXPORT_POS_BITS     24
+#define EXPORT_BKT_BITS     30
+#define EXPORT_EPOCH_BITS   5
+#define EXPORT_TOP_SHIFT    (EXPORT_EPOCH_BITS + EXPORT_BKT_BITS + EXPORT_POS_BITS)
+#define export_cursor(nb, ep, bkt, pos)  (((u64)(nb) << EXPORT_TOP_SHIFT) | \
+                                          ((u64)((ep) & ((1U << EXPORT_EPOCH_BITS) - 1)) << (EXPORT_BKT_BITS + EXPORT_POS_BITS)) | \
+                                          ((u64)(bkt) << EXPORT_POS_BITS) | (pos))
+#define export_cursor_bits(c)  ((unsigned int)((c) >> EXPORT_TOP_SHIFT))
+#define export_cursor_epoch(c) ((unsigned int)((c) >> (EXPORT_BKT_BITS + EXPORT_POS_BITS)) & ((1U << EXPORT_EPOCH_BITS) - 1))
+#define export_cursor_bkt(c)   ((unsigned int)((c) >> EXPORT_POS_BITS) & ((1U << EXPORT_BKT_BITS) - 1))
+#define export_cursor_pos(c)   ((unsigned int)(c) & ((1U << EXPORT_POS_BITS) - 1))
+#define export_epoch_of(tbl)   ((tbl)->epoch & ((1U << EXPORT_EPOCH_BITS) - 1))
+
+/*
+ * Copy entries starting at bucket *bkt, chain position *pos into kbuf (at most max). A bucket is taken
+ * whole whenever it fits so that it comes from one RCU snapshot; only a bucket longer than what is
+ * left of kbuf is split, and then only if it's the first one of this round. Returns entries copied and
+ * leaves *bkt and *pos at the first entry not copied (*bkt == number of buckets at the end of the table).
+ */
+static unsigned int ht530_export_chunk(struct ht530_table *t, struct ht530_bucket_table *tbl,
+                                       unsigned int *bkt, unsigned int *pos,
+                                       struct ht *kbuf, unsigned int max, bool drain){
+   unsigned int got = 0, start, skip, i;
+   struct ht_entry *e;
+   struct hlist_node *n;
+   struct ht530_wlock w = { .t = t, .tbl = tbl, .future = NULL };
+
+   for (; *bkt < (1U << tbl->nbits) && got < max; (*bkt)++, *pos = 0) {
+      start = got;
+      skip = *pos;
+      i = 0;
+      if (drain)
+         ht530_lock_stripe(t, ht530_bucket_lock(tbl, *bkt), 0);
+      ht530_for_each_entry(e, n, &tbl->buckets[*bkt], tbl->gen){
+         if (i < skip || !ht530_entry_is_int(e)) {   // already returned, or not an int entry
+            i++;
+            continue;
+         }
+         if (got == max)
+            break;
+         kbuf[got].key = ht530_entry_int_key(e);
+         kbuf[got].data = ht530_entry_int_data(e);
+         got++;
+         if (drain) {   // what we take leaves the chain, positions after it move up
+            w.bkt = *bkt;
+            ht530_stat_inc(t, dumps);
+            trace_ht530_dump(t->id, *bkt, kbuf[got - 1].key, kbuf[got - 1].data);
+            ht530_write_unlink(&w, e);   // hlist_del_rcu leaves ->next intact, the walk can go on
+         } else {
+            i++;
+         }
+      }
+      if (drain)
+         spin_unlock(ht530_bucket_lock(tbl, *bkt));
+      if (n) {   // bucket didn't fit
+         if (!drain && start > 0)
+            got = start;   // leave the whole bucket for the next round
+         else
+            *pos = i;
+         break;
+      }
+   }
+   return got;
+}
+
+static long ht530_ioctl_export(struct ht530_table *t, struct ht530_export __user *uexp){
+   struct ht530_export ex;
+   struct ht530_bucket_table *tbl;
+   struct ht *kbuf, __user *ubuf;
+   unsigned int bkt, pos, cbits, cep, done = 0, got, chunk;
+   bool drain;
+   long ret = 0;
+
+   if (t->open)
+      return -EOPNOTSUPP;   // the cursor is a chained bucket position
+   if (copy_from_user(&ex, uexp, sizeof(ex)))
+      return -EFAULT;
+   drain = ex.flags & HT530_EXPORT_DRAIN;
+   ex.flags &= HT530_EXPORT_DRAIN;
+   ubuf = u64_to_user_ptr(ex.buf);
+   if (ex.cursor == HT530_EXPORT_END || !ex.nr) {   // nothing (left) to do
+      ex.nr = 0;
+      return copy_to_user(uexp, &ex, sizeof(ex)) ? -EFAULT : 0;
+   }
+   chunk = min_t(unsigned int, ex.nr, PAGE_SIZE / sizeof(struct ht));
+   kbuf = kmalloc_array(chunk, sizeof(*kbuf), GFP_KERNEL);
+   if (!kbuf)
+      return -ENOMEM;
+
+   if (drain)   // draining unlinks entries, which needs a table no resize is moving them out of
+      mutex_lock(&t->resize_mutex);
+   bkt = export_cursor_bkt(ex.cursor);
+   pos = export_cursor_pos(ex.cursor);
+   cbits = export_cursor_bits(ex.cursor);
+   cep = export_cursor_epoch(ex.cursor);
+
+   while (done < ex.nr) {
+      rcu_read_lock();
+      tbl = rcu_dereference(t->tbl);
+      if (ex.cursor && cep != export_epoch_of(tbl)) {   // reseeded: entries are in other buckets now
+         bkt = 0;
+         pos = 0;
+         ex.flags |= HT530_EXPORT_RESTARTED;
+      } else if (ex.cursor && cbits != tbl->nbits) {   // carry the cursor's slice of hash space over
+         bkt = ((u64)bkt << tbl->nbits) >> cbits;
+         pos = 0;
+         ex.flags |= HT530_EXPORT_RESIZED;
+      }
+      cbits = tbl->nbits;
+      cep = export_epoch_of(tbl);
+      got = ht530_export_chunk(t, tbl, &bkt, &pos, kbuf, min(chunk, ex.nr - done), drain);
+      rcu_read_unlock();
+
+      if (got && copy_to_user(ubuf + done, kbuf, got * sizeof(*kbuf))) {
+         ret = -EFAULT;
+         break;
+      }
+      done += got;
+      ex.cursor = export_cursor(cbits, cep, bkt, pos);
+      if (bkt >= (1U << cbits)) {
+         ex.cursor = HT530_EXPORT_END;
+         break;
+      }
+      if (!got)   // a single bucket longer than the whole user buffer
+         break;
+      cond_resched();
+   }
+   if (drain)
+      mutex_unlock(&t->resize_mutex);
+   kfree(kbuf);
+   if (ret)
+      return ret;
+   ex.nr = done;
+   if (copy_to_user(uexp, &ex, sizeof(ex)))
+      return -EFAULT;
+   return 0;
+}
+
+/*
+ * HT530_BATCH: run an array of get/put/delete ops in one kernel entry. Ops are copied in and their
+ * results copied back batch_chunk at a time, and a put that found its key already present hands its
+ * preallocated entry on to the next put instead of freeing it.
+ */
+static long ht530_ioctl_batch(struct ht530_table *t, struct ht530_batch __user *ubatch){
+   struct ht530_batch batch;
+   struct ht530_op ops[batch_chunk];
+   struct ht530_op __user *uops;
+   struct ht_entry *spare = NULL;
+   unsigned int done = 0, n, i;
+   long ret = 0;
+
+   if (copy_from_user(&batch, ubatch, sizeof(batch)))
+      return -EFAULT;
+   uops = u64_to_user_ptr(batch.ops);
+
+   while (done < batch.nr) {
+      n = min_t(unsigned int, batch.nr - done, batch_chunk);
+      if (copy_from_user(ops, uops + done, n * sizeof(ops[0]))) {
+         ret = -EFAULT;
+         break;
+      }
+      for (i = 0; i < n; i++) {
+         struct ht530_op *op = &ops[i];
+
+         switch (op->op) {
+         case HT530_OP_GET:
+            op->status = ht530_get(t, op->kv.key, &op->kv.data) ? 0 : -ENOENT;
+            break;
+         case HT530_OP_PUT:
+            op->status = ht530_spare_int(t, &spare) ? ht530_put(t, op->kv.key, op->kv.data, &spare) : -ENOMEM;
+            break;
+         case HT530_OP_DEL:
+            op->status = ht530_del(t, op->kv.key, &op->kv.data) ? 0 : -ENOENT;
+            break;
+         case HT530_OP_FETCH_ADD:
+         case HT530_OP_INSERT:
+            op->status = ht530_spare_int(t, &spare) ? ht530_rmw(t, op->op, op->kv.key, op->kv.data, 0, &op->kv.data, &spare) : -ENOMEM;
+            break;
+         default:
+            op->status = -EINVAL;
+         }
+      }
+      if (copy_to_user(uops + done, ops, n * sizeof(ops[0]))) {
+         ret = -EFAULT;
+         break;
+      }
+      done += n;
+      cond_resched();
+   }
+
+   if (spare)
+      ht530_entry_free(spare);
+   if (put_user(done, &ubatch->done))
+      ret = -EFAULT;
+   return ret;
+}
+
+
+
+/*
+ * HT530_KV_GET / HT530_KV_PUT / HT530_KV_DEL: byte-string keys and values. A put builds the complete
+ * entry straight from userspace memory before taking any lock; get and delete copy the value into a
+ * bounce buffer under the lock/RCU and out to userspace afterwards.
+ */
+static long ht530_ioctl_kv_put(struct ht530_table *t, struct ht530_kv __user *ukv){
+   struct ht530_kv kv;
+   struct ht_entry *e;
+   int ret;
+
+   if (t->open)
+      return -EOPNOTSUPP;   // int keys and values only
+   if (copy_from_user(&kv, ukv, sizeof(kv)))
+      return -EFAULT;
+   if (!kv.klen || kv.klen > HT530_KEY_MAX || kv.vlen > HT530_VAL_MAX)
+      return -EINVAL;
+   e = ht530_entry_alloc(kv.klen, kv.vlen, t->ordered);
+   if (!e)
+      return -ENOMEM;
+   if (copy_from_user(e->key, u64_to_user_ptr(kv.key), kv.klen) ||
+       copy_from_user(e->val, u64_to_user_ptr(kv.val), kv.vlen)) {
+      ht530_entry_free(e);
+      return -EFAULT;
+   }
+   e->expires = ht530_expiry(kv.ttl_ms ? kv.ttl_ms : READ_ONCE(t->default_ttl_ms));
+   ret = ht530_kv_put(t, &e);
+   if (e)
+      ht530_entry_free(e);   // value stored in place, the new entry isn't needed
+   return ret;
+}
+
+static long ht530_ioctl_kv_lookup(struct ht530_table *t, struct ht530_kv __user *ukv, bool del){   /// GET or DEL
+   struct ht530_kv kv;
+   u32 cap;
+   u8 *buf;
+   int ret;
+
+   if (t->open)
+      return -EOPNOTSUPP;
+   if (copy_from_user(&kv, ukv, sizeof(kv)))
+      return -EFAULT;
+   if (!kv.klen || kv.klen > HT530_KEY_MAX)
+      return -EINVAL;
+   cap = min_t(u32, kv.vlen, HT530_VAL_MAX);
+   buf = kvmalloc(kv.klen + cap, GFP_KERNEL);   // key, then room for the value
+   if (!buf)
+      return -ENOMEM;
+   if (copy_from_user(buf, u64_to_user_ptr(kv.key), kv.klen)) {
+      kvfree(buf);
+      return -EFAULT;
+   }
+   if (del)
+      ret = ht530_kv_del(t, buf, kv.klen, buf + kv.klen, cap);
+   else
+      ret = ht530_kv_get(t, buf, kv.klen, buf + kv.klen, cap);
+   if (ret >= 0) {
+      if (copy_to_user(u64_to_user_ptr(kv.val), buf + kv.klen, min_t(u32, cap, ret)) ||
+          put_user((u32)ret, &ukv->vlen))
+         ret = -EFAULT;
+      else
+         ret = 0;
+   }
+   kvfree(buf);
+   return ret;
+}
+
+/*
+ * HT530_RANGE / HT530_NEXT / HT530_PREV. The index lock, which writers take inside their bucket locks,
+ * is held per chunk of at most range_hold bytes of records (a few hundred small ones), gathered into a
+ * bounce buffer; between chunks the scan re-seeks from the last key it returned, so writers are never
+ * held off for long and the walk survives any change to the tree.
+ */
+#define range_chunk  (128 * 1024)   /// bounce buffer, enough for a record of the largest key and value
+#define range_hold   (4 * 1024)     /// record bytes gathered per hold of index_lock, but always one record
+
+struct ht530_scan {
+   u8 *key;                // cursor: scan from (excl: just past) this key, the last one returned
+   unsigned int klen;      // 0 = from the first (desc: last) key
+   bool excl, desc;
+   const u8 *end;          // the scan stops past this key
+   unsigned int elen;      // 0 = no end
+   bool done;              // ran off the index or past end
+};
+
+static struct rb_node *ht530_index_seek(struct ht530_table *t, struct ht530_scan *sc){   /// first node of the scan, under index_lock
+   struct rb_node *n = t->index.rb_node, *best = NULL;
+   struct ht_entry *e;
+   int c;
+
+   if (!sc->klen)
+      return sc->desc ? rb_last(&t->index) : rb_first(&t->index);
+   while (n) {
+      e = rb_entry(n, struct ht530_onode, rb)->e;
+      c = ht530_key_cmp(e->key, e->klen, sc->key, sc->klen);
+      if (sc->desc)
+         c = -c;
+      if (c > 0 || (c == 0 && !sc->excl)) {   // in scan order at or after the cursor: a candidate
+         best = n;
+         n = sc->desc ? n->rb_right : n->rb_left;
+      } else {
+         n = sc->desc ? n->rb_left : n->rb_right;
+      }
+   }
+   return best;
+}
+
+static size_t ht530_entry_rec(const struct ht_entry *e, u8 *buf){   /// e as a struct ht530_rec record at buf, returns its size
+   struct ht530_rec *rec = (struct ht530_rec *)buf;
+   size_t len = HT530_REC_SIZE(e->klen, e->vlen);
+
+   rec->klen = e->klen;
+   rec->vlen = e->vlen;
+   memcpy(rec + 1, e->key, e->klen);
+   ht530_entry_read_val(e, (u8 *)(rec + 1) + e->klen, e->vlen);
+   memset((u8 *)(rec + 1) + e->klen + e->vlen, 0, len - sizeof(*rec) - e->klen - e->vlen);
+   return len;
+}
+
+/// One chunk: up to max records into buf (size bytes, range_hold per call), advancing sc. Returns bytes used, *nr records.
+static size_t ht530_index_gather(struct ht530_table *t, struct ht530_scan *sc, u8 *buf, size_t size,
+                                 unsigned int max, unsigned int *nr){
+   struct rb_node *n;
+   struct ht_entry *e;
+   size_t used = 0;
+   int c;
+
+   *nr = 0;
+   ht530_lock_stripe(t, &t->index_lock, 0);
+   for (n = ht530_index_seek(t, sc); n && *nr < max; n = sc->desc ? rb_prev(n) : rb_next(n)) {
+      e = rb_entry(n, struct ht530_onode, rb)->e;
+      if (sc->elen) {
+         c = ht530_key_cmp(e->key, e->klen, sc->end, sc->elen);
+         if (sc->desc ? c < 0 : c > 0) {
+            sc->done = true;
+            break;
+         }
+      }
+      if (ht530_expired(e))
+         continue;
+      if (used + HT530_REC_SIZE(e->klen, e->vlen) > size ||
+          (used && used + HT530_REC_SIZE(e->klen, e->vlen) > range_hold))
+         break;
+      used += ht530_entry_rec(e, buf + used);
+      (*nr)++;
+      memcpy(sc->key, e->key, e->klen);
+      sc->klen = e->klen;
+      sc->excl = true;
+   }
+   if (!n)
+      sc->done = true;   // ran off the index
+   spin_unlock(&t->index_lock);
+   return used;
+}
+
+static long ht530_ioctl_range(struct ht530_table *t, unsigned int cmd, struct ht530_range __user *urg){
+   struct ht530_range rg;
+   struct ht530_scan sc = { 0 };
+   u8 *keys, *kbuf, __user *ubuf;
+   unsigned int max, got = 0, n;
+   size_t used = 0, len;
+   long ret = 0;
+
+   if (!t->ordered)
+      return -EOPNOTSUPP;
+   if (copy_from_user(&rg, urg, sizeof(rg)))
+      return -EFAULT;
+   if (rg.klen > HT530_KEY_MAX || rg.elen > HT530_KEY_MAX)
+      return -EINVAL;
+   keys = kmalloc(2 * HT530_KEY_MAX, GFP_KERNEL);   // cursor, then end
+   kbuf = kvmalloc(min_t(size_t, rg.size, range_chunk) ?: 1, GFP_KERNEL);
+   if (!keys || !kbuf) {
+      kfree(keys);
+      kvfree(kbuf);
+      return -ENOMEM;
+   }
+   if (copy_from_user(keys, u64_to_user_ptr(rg.key), rg.klen) ||
+       copy_from_user(keys + HT530_KEY_MAX, u64_to_user_ptr(rg.end), rg.elen))
+      ret = -EFAULT;
+   sc.key = keys;
+   sc.klen = rg.klen;
+   sc.excl = cmd != HT530_RANGE;
+   sc.desc = cmd == HT530_PREV;
+   sc.end = keys + HT530_KEY_MAX;
+   sc.elen = rg.elen;
+   max = rg.nr ? rg.nr : UINT_MAX;
+   ubuf = u64_to_user_ptr(rg.buf);
+
+   while (!ret && !sc.done && got < max) {
+      len = ht530_index_gather(t, &sc, kbuf, min_t(size_t, rg.size - used, range_chunk), max - got, &n);
+      if (!n)
+         break;   // done, or the next record doesn't fit what is left of buf
+      if (copy_to_user(ubuf + used, kbuf, len))
+         ret = -EFAULT;
+      used += len;
+      got += n;
+      cond_resched();
+   }
+   kfree(keys);
+   kvfree(kbuf);
+   if (ret)
+      return ret;
+   if (!got && !sc.done)
+      return -ENOSPC;
+   rg.size = used;
+   rg.nr = got;
+   return copy_to_user(urg, &rg, sizeof(rg)) ? -EFAULT : !sc.done;
+}
+
+/*
+ * HT530_SNAP_SAVE / HT530_SNAP_LOAD, the image format is in ht530_ioctl.h. Saving walks the table with
+ * HT530_EXPORT's cursor, bucket by bucket; the running crc and count travel in the caller's struct, so
+ * the module keeps no state between calls. Loading builds every entry off to the side first, and only
+ * once the trailer checks out grows the table in one step and puts them in.
+ */
+#define snap_chunk          (128 * 1024)             /// bounce buffer, enough for the largest record
+#define HT530_SNAP_TRAILER  (HT530_SNAP_DONE - 1)    /// cursor: all records are out, the trailer isn't
+
+/// As ht530_export_chunk, with records of every live entry into kbuf (size bytes, *used so far).
+static unsigned int ht530_snap_chunk(struct ht530_table *t, struct ht530_bucket_table *tbl,
+                                     unsigned int *bkt, unsigned int *pos, u8 *kbuf, size_t size, size_t *used){
+   unsigned int got = 0, start, i;
+   size_t start_used;
+   struct ht_entry *e;
+   struct hlist_node *n;
+
+   for (; *bkt < (1U << tbl->nbits); (*bkt)++, *pos = 0) {
+      start = got;
+      start_used = *used;
+      i = 0;
+      ht530_for_each_entry(e, n, &tbl->buckets[*bkt], tbl->gen){
+         if (i < *pos || ht530_expired(e)) {
+            i++;
+            continue;
+         }
+         if (*used + HT530_REC_SIZE(e->klen, e->vlen) > size)
+            break;
+         *used += ht530_entry_rec(e, kbuf + *used);
+         got++;
+         i++;
+      }
+      if (n) {   // bucket didn't fit
+         if (start > 0) {   // leave the whole bucket for the next round
+            got = start;
+            *used = start_used;
+         } else {
+            *pos = i;
+         }
+         break;
+      }
+   }
+   return got;
+}
+
+static long ht530_ioctl_snap_save(struct ht530_table *t, struct ht530_snap __user *usnap){
+   struct ht530_snap sn;
+   struct ht530_snap_hdr hdr;
+   struct ht530_snap_tail tail;
+   struct ht530_bucket_table *tbl;
+   u8 *kbuf, __user *ubuf;
+   unsigned int bkt, pos, cbits, cep, got;
+   size_t used, done = 0;
+   long ret = 0;
+
+   if (t->open)
+      return -EOPNOTSUPP;
+   if (copy_from_user(&sn, usnap, sizeof(sn)))
+      return -EFAULT;
+   ubuf = u64_to_user_ptr(sn.buf);
+   if (sn.cursor == HT530_SNAP_DONE) {
+      sn.size = 0;
+      return copy_to_user(usnap, &sn, sizeof(sn)) ? -EFAULT : 0;
+   }
+   kbuf = kvmalloc(snap_chunk, GFP_KERNEL);
+   if (!kbuf)
+      return -ENOMEM;
+
+   if (!sn.cursor) {   // first call: the header
+      hdr.magic = HT530_SNAP_MAGIC;
+      hdr.version = HT530_SNAP_VERSION;
+      hdr.nelems = percpu_counter_sum_positive(&t->nelems);
+      if (sn.size < sizeof(hdr))
+         ret = -ENOSPC;
+      else if (copy_to_user(ubuf, &hdr, sizeof(hdr)))
+         ret = -EFAULT;
+      done = sizeof(hdr);
+      sn.crc = crc32_le(~0U, (u8 *)&hdr, sizeof(hdr));
+      sn.count = 0;
+      rcu_read_lock();
+      tbl = rcu_dereference(t->tbl);
+      sn.cursor = export_cursor(tbl->nbits, export_epoch_of(tbl), 0, 0);   // never 0, nbits >= 1
+      rcu_read_unlock();
+   }
+   bkt = export_cursor_bkt(sn.cursor);
+   pos = export_cursor_pos(sn.cursor);
+   cbits = export_cursor_bits(sn.cursor);
+   cep = export_cursor_epoch(sn.cursor);
+
+   while (!ret && sn.cursor != HT530_SNAP_TRAILER) {
+      rcu_read_lock();
+      tbl = rcu_dereference(t->tbl);
+      if (cep != export_epoch_of(tbl)) {   // reseeded: start over, a restore overwrites the repeats
+         bkt = 0;
+         pos = 0;
+      } else if (cbits != tbl->nbits) {   // resized: carry the cursor's slice of hash space over
+         bkt = ((u64)bkt << tbl->nbits) >> cbits;
+         pos = 0;
+      }
+      cbits = tbl->nbits;
+      cep = export_epoch_of(tbl);
+      used = 0;
+      got = ht530_snap_chunk(t, tbl, &bkt, &pos, kbuf, min_t(size_t, sn.size - done, snap_chunk), &used);
+      rcu_read_unlock();
+
+      if (used && copy_to_user(ubuf + done, kbuf, used)) {
+         ret = -EFAULT;
+         break;
+      }
+      sn.crc = crc32_le(sn.crc, kbuf, used);
+      sn.count += got;
+      done += used;
+      sn.cursor = bkt >= (1U << cbits) ? HT530_SNAP_TRAILER : export_cursor(cbits, cep, bkt, pos);
+      if (!got)   // buf is full
+         break;
+      cond_resched();
+   }
+   kvfree(kbuf);
+
+   if (!ret && sn.cursor == HT530_SNAP_TRAILER && sn.size - done >= sizeof(tail)) {
+      tail.magic = HT530_SNAP_TAIL;
+      tail.crc = sn.crc;
+      tail.count = sn.count;
+      if (copy_to_user(ubuf + done, &tail, sizeof(tail)))
+         ret = -EFAULT;
+      done += sizeof(tail);
+      sn.cursor = HT530_SNAP_DONE;
+   }
+   if (ret)
+      return ret;
+   if (!done)
+      return -ENOSPC;   // the next record alone is bigger than buf
+   sn.size = done;
+   return copy_to_user(usnap, &sn, sizeof(sn)) ? -EFAULT : 0;
+}
+
+/*
+ * Grow once to fit more entries, rather than doubling over and over as they arrive. Until the matching
+ * ht530_presize_end the table doesn't shrink, or the first resize check of the load would undo this.
+ */
+static void ht530_presize(struct ht530_table *t, u64 more){
+   struct ht530_bucket_table *tbl;
+   unsigned int cur, new_bits, b;
+   s64 want = percpu_counter_sum_positive(&t->nelems) + min_t(u64, more, S32_MAX);
+
+   atomic_inc(&t->loads);
+   mutex_lock(&t->resize_mutex);
+   if (t->open) {   // the fill rule only ever asks for one more doubling, follow it to the end
+      cur = rcu_dereference_protected(t->oa, lockdep_is_held(&t->resize_mutex))->nbits;
+      for (new_bits = cur; (b = ht530_oa_wanted_bits(t, new_bits, want)) > new_bits; new_bits = b)
+         ;
+      if (new_bits > cur)
+         ht530_oa_rehash(t, new_bits, READ_ONCE(t->reseed));
+   } else {
+      tbl = rcu_dereference_protected(t->tbl, lockdep_is_held(&t->resize_mutex));
+      new_bits = ht530_wanted_bits(t, tbl->nbits, want);
+      if (new_bits > tbl->nbits)
+         ht530_rehash(t, tbl, new_bits, READ_ONCE(t->reseed));   // if that fails the inserts still go in, resizing as usual
+   }
+   mutex_unlock(&t->resize_mutex);
+}
+
+static void ht530_presize_end(struct ht530_table *t){   /// the load is in, the table may shrink again if it turned out oversized
+   atomic_dec(&t->loads);
+   schedule_work(&t->resize_work);
+}
+
+static long ht530_ioctl_snap_load(struct ht530_table *t, struct ht530_snap_load __user *uload){
+   struct ht530_snap_load ld;
+   struct ht530_snap_hdr hdr;
+   struct ht530_snap_tail tail;
+   struct ht530_rec rec;
+   struct ht530_bulk *bulk;
+   struct ht_entry *e, *n;
+   struct hlist_node *tmp;
+   HLIST_HEAD(staged);   // entries built so far, chained through node[0]
+   const u8 __user *ubuf;
+   u64 off, end, count = 0, bytes = 0, cap, mb = READ_ONCE(t->max_bytes);
+   size_t len, pad_len;
+   u8 pad[8];
+   u32 crc;
+   long ret = 0;
+
+   if (t->open)
+      return -EOPNOTSUPP;
+   if (copy_from_user(&ld, uload, sizeof(ld)))
+      return -EFAULT;
+   if (ld.size < sizeof(hdr) + sizeof(tail))
+      return -EINVAL;
+   ubuf = u64_to_user_ptr(ld.buf);
+   if (copy_from_user(&hdr, ubuf, sizeof(hdr)))
+      return -EFAULT;
+   if (hdr.magic != HT530_SNAP_MAGIC || hdr.version != HT530_SNAP_VERSION)
+      return -EINVAL;
+   // Everything is staged before the trailer is checked, so bound it by what the table may hold
+   cap = ((u64)READ_ONCE(max_load) << t->max_bits) / 100;
+   if (READ_ONCE(t->max_entries))
+      cap = min_t(u64, cap, READ_ONCE(t->max_entries));
+   if (hdr.nelems > cap)
+      return -EFBIG;
+   bulk = kzalloc(sizeof(*bulk), GFP_KERNEL);
+   if (!bulk)
+      return -ENOMEM;
+
+   crc = crc32_le(~0U, (u8 *)&hdr, sizeof(hdr));
+   end = ld.size - sizeof(tail);
+   for (off = sizeof(hdr); off < end; off += len) {
+      if (end - off < sizeof(rec)) {
+         ret = -EINVAL;
+         break;
+      }
+      if (copy_from_user(&rec, ubuf + off, sizeof(rec))) {
+         ret = -EFAULT;
+         break;
+      }
+      len = HT530_REC_SIZE(rec.klen, rec.vlen);
+      if (!rec.klen || rec.klen > HT530_KEY_MAX || rec.vlen > HT530_VAL_MAX || len > end - off) {
+         ret = -EINVAL;
+         break;
+      }
+      if (count >= cap) {
+         ret = -EFBIG;
+         break;
+      }
+      e = ht530_bulk_alloc(bulk, rec.klen, rec.vlen, t->ordered);
+      if (!e) {
+         ret = -ENOMEM;
+         break;
+      }
+      hlist_add_head(&e->node[0], &staged);
+      bytes += ht530_entry_bytes(e);
+      if (mb && bytes > mb) {
+         ret = -EFBIG;
+         break;
+      }
+      pad_len = len - sizeof(rec) - rec.klen - rec.vlen;
+      if (copy_from_user(e->key, ubuf + off + sizeof(rec), rec.klen) ||
+          copy_from_user(e->val, ubuf + off + sizeof(rec) + rec.klen, rec.vlen) ||
+          copy_from_user(pad, ubuf + off + len - pad_len, pad_len)) {
+         ret = -EFAULT;
+         break;
+      }
+      crc = crc32_le(crc, (u8 *)&rec, sizeof(rec));
+      crc = crc32_le(crc, e->key, rec.klen);
+      crc = crc32_le(crc, e->val, rec.vlen);
+      crc = crc32_le(crc, pad, pad_len);
+      if (!(++count & 1023))
+         cond_resched();
+   }
+   ht530_bulk_free(bulk);
+   kfree(bulk);
+   if (!ret && copy_from_user(&tail, ubuf + end, sizeof(tail)))
+      ret = -EFAULT;
+   if (!ret && (tail.magic != HT530_SNAP_TAIL || tail.count != count || tail.crc != crc))
+      ret = -EBADMSG;   // truncated or corrupted
+   if (ret) {
+      hlist_for_each_entry_safe(e, tmp, &staged, node[0])
+         ht530_entry_free(e);
+      return ret;
+   }
+
+   ht530_presize(t, count);
+   count = 0;
+   hlist_for_each_entry_safe(e, tmp, &staged, node[0]) {   // _safe: the put reuses node[0]
+      n = e;
+      n->expires = ht530_expiry(READ_ONCE(t->default_ttl_ms));
+      ht530_kv_put(t, &n);
+      if (n)
+         ht530_entry_free(n);   // value stored in place over an existing key
+      if (!(++count & 1023))
+         cond_resched();
+   }
+   ht530_presize_end(t);
+   return put_user(count, &uload->count) ? -EFAULT : 0;
+}
+
+/*
+ * Bulk load (HT530_BULK_LOAD). Pairs come in load_chunk at a time. For a chained table each chunk is
+ * hashed and sorted by bucket, then every bucket is visited once: its lock taken once, its keys
+ * looked up, and its new entries built into a private chain that is published with a single
+ * pointer store. The chunk's entries come from one kmem_cache_alloc_bulk, and what replaces didn't
+ * use goes back the same way. resize_mutex is held over a chunk, so the generation can't change
+ * under it and no rehash is half done (future is NULL). The open-addressing backend stores pairs in
+ * its slots, so it only gets the presize and the chunked copy-in.
+ */
+#define load_chunk  4096   /// pairs copied in, sorted and linked per round
+
+struct ht530_load_rec {
+   u32 hash;
+   int key;
+   int data;
+};
+
+struct ht530_loader {   // a load's working memory, too big for the stack
+   struct ht pairs[load_chunk];
+   struct ht530_load_rec recs[load_chunk], sorted[load_chunk];
+   void *objs[load_chunk];
+   unsigned int cnt[256];
+};
+
+/// Sort n records by bucket (the top nbits of the hash), stably, a byte of bucket index per pass. Returns a or tmp, whichever holds the result.
+static struct ht530_load_rec *ht530_load_sort(struct ht530_load_rec *a, struct ht530_load_rec *tmp, unsigned int n,
+                                             unsigned int nbits, unsigned int *cnt){
+   struct ht530_load_rec *swap;
+   unsigned int shift, i, d, c;
+
+   for (shift = 32 - nbits; shift < 32; shift += 8) {
+      memset(cnt, 0, 256 * sizeof(*cnt));
+      for (i = 0; i < n; i++)
+         cnt[(a[i].hash >> shift) & 0xff]++;
+      for (i = 0, d = 0; i < 256; i++) {   // counts to first positions
+         c = cnt[i];
+         cnt[i] = d;
+         d += c;
+      }
+      for (i = 0; i < n; i++)
+         tmp[cnt[(a[i].hash >> shift) & 0xff]++] = a[i];
+      swap = a;
+      a = tmp;
+      tmp = swap;
+   }
+   return a;
+}
+
+/*
+ * Put the n records of bucket w->bkt, whose stripe the caller holds. Keys already present are
+ * updated as ht530_kv_put would; new ones take entries from objs. Returns how many it took.
+ */
+static unsigned int ht530_load_bucket(struct ht530_wlock *w, const struct ht530_load_rec *r, unsigned int n,
+                                      void **objs, unsigned int cls, unsigned long expires){
+   struct ht530_table *t = w->t;
+   struct hlist_head *head = &w->tbl->buckets[w->bkt];
+   unsigned int gen = w->tbl->gen, i, used = 0, added = 0;
+   struct hlist_node *first, *last = NULL, *node;
+   struct ht_entry *e, *new;
+   HLIST_HEAD(staged);
+   size_t bytes = 0;
+   bool replaced;
+
+   for (i = 0; i < n; i++) {
+      e = ht530_find(&staged, gen, r[i].hash, &r[i].key, sizeof(int));
+      if (e) {   // the same key earlier in this chunk, not visible to anyone yet
+         *(int *)e->val = r[i].data;
+         ht530_stat_inc(t, replaces);
+         continue;
+      }
+      e = ht530_find(head, gen, r[i].hash, &r[i].key, sizeof(int));
+      replaced = e && !ht530_expired(e);
+      if (e && !replaced)
+         ht530_stat_inc(t, expired);   // replaced all the same, but it counts as an insert
+      if (e && e->vlen == sizeof(int)) {
+         WRITE_ONCE(*(u32 *)e->val, (u32)r[i].data);
+         WRITE_ONCE(e->expires, expires);
+         WRITE_ONCE(e->ref, 1);
+         ht530_changed_entry(t, HT530_CHANGE_REPLACE, e);
+      } else {
+         new = objs[used++];
+         ht530_entry_setup(new, cls, sizeof(int), sizeof(int), true);   // an int pair always fits inline
+         memcpy(new->key, &r[i].key, sizeof(int));
+         memcpy(new->val, &r[i].data, sizeof(int));
+         new->expires = expires;
+         new->ref = 1;
+         if (!e) {   // onto the private chain, published below
+            if (t->bloom)
+               ht530_bloom_count(t, new->key, new->klen, true);
+            if (t->ordered)
+               ht530_index_insert(t, new);
+            new->hash[gen] = r[i].hash;
+            new->linked[!gen] = 0;
+            new->linked[gen] = 1;
+            hlist_add_head(&new->node[gen], &staged);
+            if (!last)
+               last = &new->node[gen];
+            bytes += ht530_entry_bytes(new);
+            added++;
+            continue;
+         }
+         ht530_write_replace(w, e, new);   // e held a value of another size
+      }
+      if (replaced) {
+         ht530_stat_inc(t, replaces);
+         trace_ht530_replace(t->id, &r[i].key, sizeof(int), sizeof(int));
+      } else {
+         ht530_stat_inc(t, inserts);
+         trace_ht530_insert(t->id, &r[i].key, sizeof(int), sizeof(int));
+      }
+   }
+   if (!added)
+      return used;
+
+   // publish the whole chain in front of the old one, as hlist_add_head_rcu would a single entry
+   first = staged.first;
+   last->next = head->first;
+   if (head->first)
+      head->first->pprev = &last->next;
+   first->pprev = &head->first;
+   rcu_assign_pointer(hlist_first_rcu(head), first);
+   percpu_counter_add(&t->nelems, added);
+   percpu_counter_add(&t->mem, bytes);
+   for (node = first; ; node = node->next) {
+      new = ht530_node_entry(node, gen);
+      ht530_changed_entry(t, HT530_CHANGE_INSERT, new);
+      ht530_stat_inc(t, inserts);
+      trace_ht530_insert(t->id, new->key, new->klen, new->vlen);
+      if (node == last)
+         break;
+   }
+   ht530_chain_check(t, w->tbl, w->bkt);
+   return used;
+}
+
+/// Put the first n of ld->pairs into t. Returns how many went in, or a negative errno if none did.
+static long ht530_load_chunk(struct ht530_table *t, struct ht530_loader *ld, unsigned int n){
+   unsigned long expires = ht530_expiry(READ_ONCE(t->default_ttl_ms));
+   struct ht530_load_rec *r;
+   struct ht530_wlock w;
+   unsigned int i, j, cls, used = 0;
+   spinlock_t *lock;
+   bool inline_val;
+   int ret;
+
+   if (t->open) {
+      for (i = 0; i < n; i++) {
+         ret = ht530_oa_put(t, ld->pairs[i].key, ld->pairs[i].data);
+         if (ret < 0)
+            return i ? i : ret;
+      }
+      return n;
+   }
+   cls = ht530_entry_class(sizeof(int), sizeof(int), t->ordered, &inline_val);
+   // more than the inserts will need when keys repeat or are present, the rest goes back below
+   if (!kmem_cache_alloc_bulk(ht530_entry_cache[cls], GFP_KERNEL, n, ld->objs))
+      return -ENOMEM;
+   if (expires)
+      ht530_reap_start(t);
+
+   mutex_lock(&t->resize_mutex);
+   w.t = t;
+   w.tbl = rcu_dereference_protected(t->tbl, lockdep_is_held(&t->resize_mutex));
+   w.future = NULL;
+   for (i = 0; i < n; i++) {
+      ld->recs[i].key = ld->pairs[i].key;
+      ld->recs[i].data = ld->pairs[i].data;
+      ld->recs[i].hash = ht530_hash(&w.tbl->key, &ld->recs[i].key, sizeof(int));
+   }
+   r = ht530_load_sort(ld->recs, ld->sorted, n, w.tbl->nbits, ld->cnt);
+   for (i = 0; i < n; i = j) {
+      // the buckets come in order but far apart: start on the bucket heads and then the chains ahead
+      if (i + 8 < n)
+         prefetch(&w.tbl->buckets[ht530_bucket(w.tbl, r[i + 8].hash)]);
+      if (i + 4 < n)
+         prefetch(READ_ONCE(w.tbl->buckets[ht530_bucket(w.tbl, r[i + 4].hash)].first));
+      w.hash = r[i].hash;
+      w.bkt = ht530_bucket(w.tbl, w.hash);
+      for (j = i + 1; j < n && ht530_bucket(w.tbl, r[j].hash) == w.bkt; j++)
+         ;
+      lock = ht530_bucket_lock(w.tbl, w.bkt);
+      ht530_lock_stripe(t, lock, 0);
+      used += ht530_load_bucket(&w, r + i, j - i, ld->objs + used, cls, expires);
+      spin_unlock(lock);
+      if ((i >> 10) != (j >> 10))
+         cond_resched();   // only resize_mutex held here
+   }
+   ht530_resize_check(t, w.tbl);
+   mutex_unlock(&t->resize_mutex);
+
+   if (used < n)
+      kmem_cache_free_bulk(ht530_entry_cache[cls], n - used, ld->objs + used);
+   ht530_enforce_budget(t);
+   return n;
+}
+
+/// Fill ld->pairs with up to want pairs from the load's source, advancing it. Returns the number read, 0 at the end.
+static long ht530_load_fill(struct ht530_loader *ld, const struct ht __user **ubuf, struct file *file,
+                            loff_t *pos, unsigned int want){
+   size_t len = (size_t)want * sizeof(struct ht), got = 0;
+   ssize_t ret;
+
+   if (!file) {
+      if (copy_from_user(ld->pairs, *ubuf, len))
+         return -EFAULT;
+      *ubuf += want;
+      return want;
+   }
+   while (got < len) {   // pipes and the like return short reads
+      ret = kernel_read(file, (u8 *)ld->pairs + got, len - got, pos);
+      if (ret < 0)
+         return ret;
+      if (!ret)
+         break;
+      got += ret;
+   }
+   if (got % sizeof(struct ht))
+      return -EINVAL;   // the file ends in the middle of a pair
+   return got / sizeof(struct ht);
+}
+
+static long ht530_ioctl_bulk_load(struct ht530_table *t, struct ht530_bulk_load __user *ubl){   /// HT530_BULK_LOAD
+   struct ht530_bulk_load bl;
+   const struct ht __user *ubuf;
+   struct ht530_loader *ld;
+   struct fd f = { NULL };
+   u64 left, loaded = 0;
+   loff_t pos, size;
+   long n, ret = 0;
+
+   if (copy_from_user(&bl, ubl, sizeof(bl)))
+      return -EFAULT;
+   ubuf = u64_to_user_ptr(bl.buf);
+   left = bl.count;
+   pos = bl.offset;
+   if (!bl.buf) {
+      if (bl.offset > S64_MAX)
+         return -EINVAL;
+      f = fdget(bl.fd);
+      if (!f.file)
+         return -EBADF;
+      if (!(f.file->f_mode & FMODE_READ)) {
+         fdput(f);
+         return -EBADF;
+      }
+      size = i_size_read(file_inode(f.file));   // 0 for pipes and the like: no presize then
+      if (!left)
+         left = size > pos ? (size - pos) / sizeof(struct ht) : 0;
+   }
+   ld = kvmalloc(sizeof(*ld), GFP_KERNEL);
+   if (!ld) {
+      if (f.file)
+         fdput(f);
+      return -ENOMEM;
+   }
+
+   ht530_presize(t, left);
+   if (f.file && !bl.count)
+      left = U64_MAX;   // the size was only a hint, read to the end
+   while (left && !ret) {
+      n = ht530_load_fill(ld, &ubuf, f.file, &pos, min_t(u64, left, load_chunk));
+      if (n <= 0) {
+         ret = n;
+         break;
+      }
+      left -= n;
+      ret = ht530_load_chunk(t, ld, n);
+      if (ret > 0) {
+         loaded += ret;
+         ret = ret < n ? -ENOSPC : 0;   // an open-addressing table full at max_bits
+      }
+      cond_resched();
+   }
+   ht530_presize_end(t);
+   kvfree(ld);
+   if (f.file)
+      fdput(f);
+   if (put_user(loaded, &ubl->loaded))
+      return -EFAULT;
+   return ret;
+}
+
+static long ht530_ioctl_rmw(struct ht530_table *t, struct ht530_rmw __user *urmw){   /// HT530_RMW
+   struct ht530_rmw rmw;
+   struct ht_entry *spare = NULL;
+   int old = 0;
+   long ret;
+
+   if (copy_from_user(&rmw, urmw, sizeof(rmw)))
+      return -EFAULT;
+   switch (rmw.op) {
+   case HT530_OP_DEL:   // get-and-delete is what DEL always was
+      ret = ht530_del(t, rmw.key, &old) ? 0 : -ENOENT;
+      break;
+   case HT530_OP_FETCH_ADD:
+   case HT530_OP_INSERT:
+      if (!t->open) {   // the open-addressing backend doesn't use entries
+         spare = ht530_entry_alloc_int(t);   // before the bucket lock, in case the key is absent
+         if (!spare)
+            return -ENOMEM;
+      }
+      /* fall through */
+   case HT530_OP_CAS:
+      ret = ht530_rmw(t, rmw.op, rmw.key, rmw.data, rmw.expected, &old, &spare);
+      break;
+   default:
+      return -EINVAL;
+   }
+   if (spare)
+      ht530_entry_free(spare);
+   if (put_user(old, &urmw->old))
+      return -EFAULT;
+   return ret;
+}
+
+/// The per-table ioctls; the device file handles those about fds and the table list itself.
+long ht530_table_ioctl(struct ht530_table *t, unsigned int ioctl_num, unsigned long ioctl_param){
+   switch (ioctl_num) {
+   case DUMP:
+      return ht530_ioctl_dump(t, ioctl_num, ioctl_param);
+   case HT530_BATCH:
+      return ht530_ioctl_batch(t, (struct ht530_batch __user *)ioctl_param);
+   case HT530_RMW:
+      return ht530_ioctl_rmw(t, (struct ht530_rmw __user *)ioctl_param);
+   case HT530_SNAP_SAVE:
+      return ht530_ioctl_snap_save(t, (struct ht530_snap __user *)ioctl_param);
+   case HT530_SNAP_LOAD:
+      return ht530_ioctl_snap_load(t, (struct ht530_snap_load __user *)ioctl_param);
+   case HT530_BULK_LOAD:
+      return ht530_ioctl_bulk_load(t, (struct ht530_bulk_load __user *)ioctl_param);
+   case HT530_RANGE:
+   case HT530_NEXT:
+   case HT530_PREV:
+      return ht530_ioctl_range(t, ioctl_num, (struct ht530_range __user *)ioctl_param);
+   case HT530_EXPORT:
+      return ht530_ioctl_export(t, (struct ht530_export __user *)ioctl_param);
+   case HT530_KV_GET:
+      return ht530_ioctl_kv_lookup(t, (struct ht530_kv __user *)ioctl_param, false);
+   case HT530_KV_PUT:
+      return ht530_ioctl_kv_put(t, (struct ht530_kv __user *)ioctl_param);
+   case HT530_KV_DEL:
+      return ht530_ioctl_kv_lookup(t, (struct ht530_kv __user *)ioctl_param, true);
+   default:
+      return -ENOTTY;
+   }
+}
@@ -0,0 +1,356 @@
+/**
+ * @file   ht530_core.h
+ * @brief   Table core of ht530: entries, buckets, backends and the per-table ioctls
+ *
+ * The core knows nothing about files or device nodes; ht530_dev.c wraps it in the char device.
+ * Built with __KERNEL__ it is part of the module, without it it builds against ht530_shim.h into
+ * a userspace library for the in-process stand-in of /dev/ht530 (see ht530_mock.h).
+ */
+
+#ifndef HT530_CORE_H
+#define HT530_CORE_H
+
+#ifdef __KERNEL__
+#include <linux/kernel.h>           // Contains types, macros, functions for the kernel
+#include <linux/types.h>            // u32  and other d.types etc.
+#include <linux/spinlock.h>         /// per-bucket-stripe locks
+#include <linux/mutex.h>            /// serializes resizes
+#include <linux/workqueue.h>        /// resizes run in the background
+#include <linux/percpu_counter.h>   /// entry count without a shared hot counter
+#include <linux/rcupdate.h>         /// lock-free lookups, deferred entry reclamation
+#include <linux/rculist.h>          /// RCU chain walks
+#include <linux/percpu.h>           /// per-CPU counters
+#include <linux/wait.h>             /// change-log readers
+#include <linux/jump_label.h>       /// static key behind the debug parameter
+#include <linux/kref.h>             /// tables outlive their removal while fds still hold them
+#include <linux/siphash.h>          /// keyed key hashing
+#include <linux/percpu-rwsem.h>     /// open-addressing writers vs. its resize
+#include <linux/rbtree.h>           /// key-ordered index of ordered tables
+#include <linux/memcontrol.h>       /// the memcg resizes charge
+#include <linux/ktime.h>            /// latency histograms
+#include <linux/vmalloc.h>          /// the view, mapped into readers
+#else
+#include "ht530_shim.h"             /// the same names over pthreads and libc
+#endif
+
+#include "ht530_ioctl.h"            /// struct ht, dump_arg and the ioctl numbers shared with userspace
+
+/*
+ * Per-operation logging. Nothing on the read/write/ioctl paths printks unconditionally: individual
+ * operations are visible through the ht530:* tracepoints, and the old chatty messages are only
+ * emitted (at KERN_DEBUG) while the debug parameter is set. The parameter flips a static key, so
+ * with it off each ht530_dbg() costs a patched-out jump.
+ */
+DECLARE_STATIC_KEY_FALSE(ht530_debug_key);
+
+#define ht530_dbg(fmt, ...)                                             \
+   do {                                                                 \
+      if (static_branch_unlikely(&ht530_debug_key))                    \
+         printk(KERN_DEBUG "ht530: " fmt, ##__VA_ARGS__);              \
+   } while (0)
+
+/*
+ * Profiling (profile=1, a static key as for debug). Lookups, puts, deletes, DUMPs and opens are timed
+ * with ktime_get_ns() into per-CPU log2-nanosecond histograms, one for the time spent waiting for
+ * locks (bucket stripes, the resize mutex, the table list) and one for everything else; a lock taken
+ * on the first try counts as no wait at all. Keys are sampled into count-min sketches that keep the
+ * hottest ones: 1 in hot_sample operations, and every bucket lock acquisition that had to wait.
+ * Both are read in debugfs (latency, hot).
+ */
+DECLARE_STATIC_KEY_FALSE(ht530_prof_key);
+
+#define lat_get     0    /// lookups: read(), HT530_KV_GET, batches and rings
+#define lat_put     1    /// inserts and replaces
+#define lat_del     2
+#define lat_dump    3    /// DUMP of one bucket
+#define lat_open    4    /// dev_open; the wait is for the table list
+#define lat_nr_ops  5
+#define lat_slots   32   /// slot i counts times in [2^i, 2^(i+1)) ns (slot 0 also 0), the last one anything longer
+
+struct ht530_lat {
+   u64 wait[lat_nr_ops][lat_slots];   // waiting for locks
+   u64 work[lat_nr_ops][lat_slots];   // the rest of the operation
+   u32 sample;                        // operations seen on this CPU, picks the 1 in hot_sample
+};
+
+#define hot_depth    4    /// count-min rows
+#define hot_width    512  /// counters per row
+#define hot_top      16   /// hottest keys kept
+#define hot_key_max  16   /// key bytes kept of each; longer keys that share them count as one
+#define hot_ops        0  /// sketch of sampled operations
+#define hot_contended  1  /// sketch of bucket lock acquisitions that waited
+
+struct ht530_hot_key {
+   u32 count;                 // count-min estimate when last seen, 0 = free
+   u16 klen;
+   u8 key[hot_key_max];
+};
+
+struct ht530_hot {
+   spinlock_t lock;           // only ever trylock'd by the samplers: a sample that finds it held is dropped
+   hsiphash_key_t hkey;
+   u32 samples;               // since the counts were last halved
+   u32 cm[hot_depth][hot_width];
+   struct ht530_hot_key top[hot_top];
+};
+
+static inline u64 ht530_lat_start(void){   /// start of a profiled operation, 0 while profiling is off
+   return static_branch_unlikely(&ht530_prof_key) ? ktime_get_ns() : 0;
+}
+
+
+/*
+ * Entries hold a length-prefixed key and value. The key always sits inline after the header; the
+ * value follows it (8-byte aligned) when the whole entry fits the largest size class, otherwise it is
+ * a separate allocation. Key and length never change once an entry is visible. A 4- or 8-byte value
+ * may be overwritten in place (readers load it with READ_ONCE); any other value change replaces the
+ * entry with a new one, so readers never see a half-written value.
+ */
+struct ht_entry {    // hash table entry struct for kernel inplementation
+struct hlist_node node[2];   // chain linkage in the current and, during a resize, the next bucket table
+u8 linked[2];                // node[i] is on a chain; guarded by that table's bucket lock
+u8 cls;                      // size class the entry was allocated from
+u8 ref;                      // CLOCK reference bit: set by lookups, cleared by the eviction hand
+u16 klen;
+u32 vlen;
+u32 hash[2];                 // hash of the key under each generation's hash key, as node[]
+struct rcu_head rcu;   // deferred free once lock-free readers are done with the entry
+u8 *val;                     // value bytes: inline in key[] or out of line
+unsigned long expires;       // jiffies after which the entry is gone, 0 = never
+u8 key[] __aligned(8);       // klen key bytes, then the value when it is inline
+};
+
+struct ht530_lock {   // one lock stripe, padded so neighbouring stripes don't share a cache line
+   spinlock_t lock;
+} ____cacheline_aligned_in_smp;
+
+/*
+ * The table is a chain of bucket-array generations. Normally there is one (ht530_table::tbl); while the
+ * resize worker runs, tbl->future points at the next one and the worker copies tbl's buckets into it
+ * in order, advancing tbl->rehash. Every entry has two hlist linkages, one per generation, so copying
+ * an entry into the future table never disturbs readers still walking the current chains. Readers only
+ * ever look at ht530_table::tbl under RCU; once every bucket is copied the worker publishes the future table,
+ * waits a grace period and frees the old bucket array.
+ *
+ * Writers lock the key's bucket in tbl. If that bucket was already copied they also lock the key's
+ * bucket in the future table, look the key up there (it is authoritative for every key of a copied
+ * bucket) and link/unlink through both generations.
+ */
+struct ht530_bucket_table {   // one generation of buckets
+   unsigned int nbits;         // 2^nbits buckets
+   unsigned int gen;           // which ht_entry::node[] / linked[] this generation uses
+   unsigned int lock_mask;     // bucket b is guarded by locks[b & lock_mask]
+   unsigned int rehash;        // buckets below this are already copied into future
+   unsigned int epoch;         // reseeds so far, for HT530_EXPORT cursors
+   hsiphash_key_t key;         // hash key of this generation; a resize keeps it, a reseed picks a new one
+   struct ht530_bucket_table __rcu *future;   // next generation while a resize is in progress
+   struct ht530_lock *locks;   // lock stripes over this generation's buckets
+   struct hlist_head buckets[];
+};
+
+/*
+ * Operation counters. Each CPU bumps its own copy with a plain this_cpu_inc, so counting never
+ * shares a cache line between CPUs; readers (debugfs) sum over all possible CPUs. The sum is not a
+ * snapshot, individual counters may be a few operations apart.
+ */
+struct ht530_stats {
+   u64 gets;        // lookups, = hits + misses
+   u64 hits;
+   u64 misses;
+   u64 inserts;
+   u64 replaces;
+   u64 deletes;     // explicit deletes
+   u64 dumps;       // entries drained by DUMP or HT530_EXPORT_DRAIN
+   u64 contended;   // bucket lock acquisitions that found the stripe already held
+   u64 evictions;   // entries the CLOCK hand dropped to stay within budget
+   u64 expired;     // entries found past their TTL, by a lookup, a writer or the reaper
+   u64 reseeds;     // rehashes under a new hash key after a chain grew past chain_max
+   u64 reclaimed;   // entries given back to memory reclaim (cache tables)
+   u64 idle_drops;  // times reclaim emptied the whole table for being idle
+   u64 bloom_skips; // misses the Bloom filter answered without a chain walk
+   u64 bloom_fps;   // misses it let through to the chain anyway: its false positives
+};
+
+#define HT530_NR_STATS  (sizeof(struct ht530_stats) / sizeof(u64))
+
+/*
+ * One table instance per minor number (see HT530_TABLE_CREATE). Tables share nothing but the entry
+ * slab cache: each has its own bucket arrays, lock stripes, counters and resize worker.
+ */
+struct ht530_table {
+   struct ht530_bucket_table __rcu *tbl;   // current generation, what readers walk
+   struct percpu_counter nelems;           // approximate entry count, drives resizing
+   struct percpu_counter mem;              // bytes held by entries (size class + out-of-line value)
+   struct ht530_stats __percpu *stats;
+   struct mutex resize_mutex;              // one resize (or destructive bucket DUMP) at a time
+   struct work_struct resize_work;
+   atomic_t loads;                         // bulk loads in progress, between ht530_presize and its _end; no shrinking meanwhile
+   unsigned int id;                        // minor number
+   unsigned int init_bits, max_bits;       // this table's size bounds
+   u64 max_entries, max_bytes;             // budget, 0 = unlimited; tunable in debugfs
+   u32 default_ttl_ms;                     // TTL of entries put without one, 0 = none
+   atomic_t clock_hand;                    // next bucket the eviction hand visits
+   bool has_ttl;                           // some entry was given a TTL, keep the reaper running
+   unsigned int reap_pos;                  // next bucket the reaper visits; reaper only
+   struct delayed_work reap_work;
+   bool open;                              // open-addressing backend: oa instead of tbl, see below
+   struct ht530_oa_table __rcu *oa;
+   struct percpu_rw_semaphore oa_rwsem;    // read-held by oa writers, write-held by an oa resize
+   u32 chain_max;                          // reseed once a chain is this much longer than average, 0 = never
+   bool reseed;                            // the next rehash picks a new hash key
+   bool ordered;                           // entries are also kept in index, see struct ht530_onode
+   bool cache;                             // HT530_TABLE_CACHE: on ht530_cache_tables, the shrinker may evict
+   struct list_head cache_node;
+   u64 reclaim_ops;                        // operations counted at the shrinker's last look, under ht530_cache_lock
+   unsigned long reclaim_stamp;            // jiffies when that count last changed
+   struct mem_cgroup *memcg;               // creator's memcg, charged for what the resize worker allocates
+   struct ht530_lat __percpu *lat;         // profiling, see ht530_lat_start
+   struct ht530_hot *hot;                  // [hot_ops], [hot_contended]
+   u32 *bloom;                             // counting Bloom filter of the keys, NULL = none; see below
+   unsigned int bloom_bits;                // log2 of its counters
+   hsiphash_key_t bloom_key;
+   struct ht530_view_hdr *view;            // read-only view for mmap, NULL = none; see ht530_ioctl.h
+   struct ht530_view_line *view_lines;
+   size_t view_size;                       // bytes of view, page-aligned
+   spinlock_t index_lock;
+   struct rb_root index;
+   spinlock_t watch_lock;                  // orders changes for the watchers, taken inside the bucket locks
+   struct list_head watchers;              // struct ht530_watcher, under watch_lock
+   u64 change_seq;                         // last change logged, under watch_lock
+   struct kref ref;                        // held by the table list and by every open fd
+   struct device *dev;
+   struct dentry *debugfs;
+};
+
+#define ht530_stat_inc(t, field)  this_cpu_inc((t)->stats->field)
+
+/*
+ * Keys are hashed with hsiphash under a random key per bucket-table generation, so nobody outside can
+ * predict which keys share a bucket, and sequential or strided ids spread as well as random ones.
+ * Should a chain still grow past chain_max above the average (see ht530_write_link), the resize
+ * worker rehashes everything into a generation with a new key, readers carrying on in the old one.
+ */
+static inline u32 ht530_hash(const hsiphash_key_t *hk, const void *key, unsigned int klen){
+   u32 k;
+
+   if (klen == sizeof(k)) {   // int keys, the common case, take the shortcut
+      memcpy(&k, key, sizeof(k));
+      return hsiphash_1u32(k, hk);
+   }
+   return hsiphash(key, klen, hk);
+}
+
+/*
+ * Negative lookups (bloom_bits). A chained table may keep a counting Bloom filter of its keys that
+ * lookups check before walking a chain, so most misses read one cache line instead of a chain. The
+ * filter is blocked: a key's bloom_k counters all sit in one block of bloom_block byte counters,
+ * four to a u32 word, 64 bytes in all. Block and counters come from a hash of the key under the
+ * filter's own key, which unlike a bucket table's never changes.
+ */
+#define bloom_k      4    /// counters per key
+#define bloom_block  64   /// counters per block, one cache line
+
+static inline unsigned int ht530_bloom_counter(const u32 *block, unsigned int slot){   /// value of counter slot of a block
+   return (READ_ONCE(block[slot / 4]) >> (slot % 4 * 8)) & 0xff;
+}
+
+static inline unsigned int ht530_bucket(const struct ht530_bucket_table *tbl, u32 hash){   /// bucket index of a key hash in tbl
+   return hash >> (32 - tbl->nbits);   // top bits, so a bucket is a contiguous slice of hash space
+}
+
+static inline struct ht_entry *ht530_node_entry(struct hlist_node *n, unsigned int gen){   /// entry owning linkage node[gen]
+   return container_of(n - gen, struct ht_entry, node[0]);
+}
+
+/// Walk a chain of generation gen. Caller holds rcu_read_lock or the chain's bucket lock.
+#define ht530_for_each_entry(pos, n, head, gen) \
+   for (n = rcu_dereference_raw(hlist_first_rcu(head)); \
+        n && ({ pos = ht530_node_entry(n, gen); 1; }); \
+        n = rcu_dereference_raw(hlist_next_rcu(n)))
+
+
+/*
+ * Change log (HT530_WATCH). Writers log every change while still holding the key's bucket lock, so
+ * one key's changes reach a watcher in the order they were made; watch_lock puts all of the table's
+ * changes in one order and numbers them. Each watcher has a byte ring of records that the writer
+ * appends to and the fd's reader consumes from. A full ring drops records and remembers the first
+ * one lost instead of making the writer wait. Without watchers a change costs one list_empty().
+ */
+struct ht530_watcher {
+   struct list_head node;        // on the table's watchers
+   u8 *buf;                      // size bytes of records
+   u64 size, head, tail;         // head/tail: bytes ever written/read, under watch_lock
+   u64 lost, lost_seq;           // records dropped since the reader last caught up, the first of them
+   u32 nkeys;                    // key filter, 0 = every key
+   u8 *keys;                     // nkeys struct ht530_rec records with vlen 0
+   struct mutex read_lock;       // one reader at a time
+   wait_queue_head_t wait;
+};
+
+/*
+ * Open-addressing backend (backend=open), int keys and values only. A bucket is one cache line: a
+ * control word and oa_slots 8-byte slots, each holding a key and its value packed into one word, so
+ * a lookup usually reads a single line and follows no pointers. Bytes 0-6 of the control word tag
+ * the slots (0x80 | 7 hash bits, 0 = free, oa_reserved = being filled in); byte 7 counts the keys
+ * that probed past the bucket. A key goes into the first bucket with a free slot from its home
+ * bucket (top hash bits) on, and a lookup stops at the first bucket whose count is 0. Counts
+ * saturate at 255 and stay there until the next resize rebuilds the table.
+ *
+ * Readers are lock-free under RCU. Key and value change together in one 64-bit store, so a reader
+ * never sees a torn pair even while a slot is recycled; the key comparison weeds out stale tags.
+ * Writers serialise per home bucket on a lock stripe, which is enough to keep each key in one slot,
+ * and claim or release slots in any bucket with cmpxchg on its control word. A resize rebuilds the
+ * whole table with writers held off by oa_rwsem; readers keep using the old copy meanwhile.
+ *
+ * Tags are matched all at once with SWAR arithmetic on the control word: seven tags fit a register,
+ * so SSE/AVX would buy nothing and cost a kernel_fpu_begin() per lookup.
+ */
+#define oa_slots      7     /// key/value slots per bucket, with the control word 64 bytes
+#define oa_reserved   0x01  /// tag of a claimed slot whose key/value isn't written yet
+#define oa_ovf_shift  56    /// the overflow count is the control word's top byte
+#define oa_max_fill   80    /// grow when more than this percentage of slots are used
+#define oa_min_fill   20    /// shrink when fewer are
+
+#define oa_ones  0x0101010101010101ULL
+#define oa_lows  0x7f7f7f7f7f7f7f7fULL
+
+struct ht530_oa_bucket {
+   u64 ctrl;               // slot tags, overflow count
+   u64 slot[oa_slots];     // key in the low 32 bits, value in the high 32 bits
+} __aligned(64);
+
+struct ht530_oa_table {
+   unsigned int nbits;     // 2^nbits buckets
+   unsigned int lock_mask;
+   hsiphash_key_t key;     // hash key, new with every rebuild since that rehashes every key anyway
+   struct ht530_lock *locks;   // writers lock the stripe of the key's home bucket
+   struct ht530_oa_bucket *buckets;
+};
+
+static inline unsigned int ht530_oa_home(const struct ht530_oa_table *oa, u32 hash){
+   return hash >> (32 - oa->nbits);
+}
+
+extern unsigned int init_bits, max_bits, hot_sample;
+
+int ht530_core_init(void);
+void ht530_core_exit(void);
+struct ht530_table *ht530_table_new(const struct ht530_table_info *info);
+void ht530_table_free(struct ht530_table *t);
+
+bool ht530_get(struct ht530_table *t, int key, int *data);
+int ht530_put(struct ht530_table *t, int key, int data, struct ht_entry **spare);
+bool ht530_del(struct ht530_table *t, int key, int *data);
+int ht530_rmw(struct ht530_table *t, u32 op, int key, int data, int expected, int *old,
+              struct ht_entry **spare);
+void ht530_lat_end(struct ht530_table *t, unsigned int op, u64 start, u64 wait);
+struct ht_entry *ht530_entry_alloc_int(const struct ht530_table *t);
+bool ht530_spare_int(const struct ht530_table *t, struct ht_entry **spare);
+void ht530_entry_free(struct ht_entry *e);
+void ht530_watch_copy(struct ht530_watcher *w, const void *src, size_t len);
+
+ssize_t ht530_table_read(struct ht530_table *t, char __user *buffer);
+ssize_t ht530_table_write(struct ht530_table *t, const char __user *buffer, size_t len);
+long ht530_table_ioctl(struct ht530_table *t, unsigned int ioctl_num, unsigned long ioctl_param);
+
+#endif
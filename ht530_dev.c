@@ -0,0 +1,1092 @@
+/**
+ * @file   ht530_dev.c
+ * @author Aditya  Jha
+ * @date   5 Dec 2020
+ * @version 0
+ * @brief   Accessing a kernel hash table via devicefile interface
+ *
+ * The char device: fds, rings, watchers, debugfs and the table list. The tables themselves live in
+ * ht530_core.c.
+ */
+
+#include <linux/init.h>           // Macros used to mark up functions e.g. __init __exit
+#include <linux/module.h>         // Core header for loading LKMs into the kernel
+#include <linux/device.h>         // Header to support the kernel Driver Model
+#include <linux/kernel.h>         // Contains types, macros, functions for the kernel
+#include <linux/fs.h>             // Header for the Linux file system support
+#include <linux/uaccess.h>          // Required for the copy to user function
+#include <linux/atomic.h>           /// open counter shared by concurrent opens
+#include <linux/slab.h>             /// per-fd state
+#include <linux/mm.h>               /// mmap of the rings and the view
+#include <linux/vmalloc.h>          /// ring memory
+#include <linux/sched/mm.h>         /// memalloc_use_memcg in the SQPOLL server
+#include <linux/kthread.h>          /// SQPOLL ring server
+#include <linux/sched.h>            /// task refs, wake_up_process
+#include <linux/moduleparam.h>      /// ntables, ordered
+#include <linux/debugfs.h>          /// /sys/kernel/debug/ht530 telemetry
+#include <linux/seq_file.h>         /// ...rendered with seq_file
+#include <linux/idr.h>              /// table instances by minor number
+#include <linux/capability.h>       /// table create/destroy is privileged
+#include <linux/poll.h>             /// change-log watchers
+#include <linux/math64.h>           /// div64_u64 for the Bloom filter estimate
+
+#include "ht530_core.h"             /// the tables, and ht530_ioctl.h
+
+#define  DEVICE_NAME "ht530"    ///< The device will appear at /dev/ht530 using this value
+#define  CLASS_NAME  "ht"        ///< The device class -- this is a character device driver
+
+
+MODULE_LICENSE("GPL");            ///< The license type -- this affects available functionality
+MODULE_AUTHOR("Aditya  Jha");    ///< The author -- visible when you use modinfo
+MODULE_DESCRIPTION("A simple Linux char driver for Hash Table");  ///< The description -- see modinfo
+MODULE_VERSION("0.1");            ///< A version number to inform users
+
+
+
+static int    majorNumber;                  ///< Stores the device number -- determined automatically
+static atomic_t numberOpens = ATOMIC_INIT(0); ///< Counts the number of times the device is opened
+static struct class*  ht530Class  = NULL; ///< The device-driver class struct pointer
+
+
+static DEFINE_IDR(ht530_tables);            /// live tables by id; the device nodes of removed ones are gone
+static DEFINE_MUTEX(ht530_tables_lock);     /// guards ht530_tables
+
+static unsigned int ntables = 1;
+module_param(ntables, uint, 0444);
+MODULE_PARM_DESC(ntables, "tables created at load time, /dev/ht530 and /dev/ht530-1 ... (default 1, at most 256)");
+static bool ordered;
+module_param(ordered, bool, 0444);
+MODULE_PARM_DESC(ordered, "keep the tables created at load time in key order too, for range scans (default off)");
+static bool cache;
+module_param(cache, bool, 0444);
+MODULE_PARM_DESC(cache, "let memory reclaim evict from the tables created at load time (default off)");
+static unsigned int sqpoll_max = 4;
+module_param(sqpoll_max, uint, 0644);
+MODULE_PARM_DESC(sqpoll_max, "HT530_RING_SQPOLL threads allowed at once, module-wide (default 4)");
+static atomic_t ht530_sqpoll_nr = ATOMIC_INIT(0);   /// SQPOLL threads running
+
+#define sq_idle_max_ms  1000   /// longest an SQPOLL thread may spin idle before it sleeps
+
+/*
+ * Shared-memory submission/completion rings (see ht530_ioctl.h). The module keeps its own copies of
+ * the indices it owns (sq_head, cq_tail) and only ever reads userspace's (sq_tail, cq_head), and every
+ * SQE is copied out of shared memory before it is looked at, so a misbehaving process can only
+ * confuse its own rings.
+ */
+struct ht530_ring {
+   struct ht530_table *table;    // the fd's table, which the fd keeps alive for as long as the ring
+   struct ht530_ring_hdr *hdr;   // vmalloc'd and charged to the creator, mapped into the process
+   struct ht530_sqe *sqes;
+   struct ht530_cqe *cqes;
+   size_t map_size;
+   u32 sq_mask, cq_mask;
+   u32 sq_head, cq_tail;         // authoritative copies of the module-owned indices
+   struct mutex lock;            // one drainer at a time
+   struct ht_entry *spare;       // preallocated entry carried between puts
+   wait_queue_head_t cq_wait;    // HT530_ENTER_GETEVENTS waiters
+   struct task_struct *sq_thread;   // HT530_RING_SQPOLL server
+   unsigned long sq_idle;        // jiffies the server spins before sleeping
+   struct mem_cgroup *memcg;     // creator's memcg, charged for what the server inserts
+};
+
+struct ht530_file {   // per-open state
+   struct ht530_table *table;    // the minor's table at open time, referenced until release
+   struct mutex lock;            // guards setup of the fields below
+   struct ht530_ring *ring;
+   struct ht530_watcher *watch;  // HT530_WATCH: read() returns the change log
+};
+
+static void ht530_ring_exec(struct ht530_ring *r, const struct ht530_sqe *sqe, struct ht530_cqe *cqe){
+   cqe->user_data = sqe->user_data;
+   cqe->data = 0;
+   switch (sqe->op) {
+   case HT530_OP_GET:
+      cqe->status = ht530_get(r->table, sqe->kv.key, &cqe->data) ? 0 : -ENOENT;
+      break;
+   case HT530_OP_PUT:
+      cqe->status = ht530_spare_int(r->table, &r->spare) ? ht530_put(r->table, sqe->kv.key, sqe->kv.data, &r->spare) : -ENOMEM;
+      break;
+   case HT530_OP_DEL:
+      cqe->status = ht530_del(r->table, sqe->kv.key, &cqe->data) ? 0 : -ENOENT;
+      break;
+   case HT530_OP_FETCH_ADD:
+   case HT530_OP_INSERT:
+      cqe->status = ht530_spare_int(r->table, &r->spare) ? ht530_rmw(r->table, sqe->op, sqe->kv.key, sqe->kv.data, 0, &cqe->data, &r->spare) : -ENOMEM;
+      break;
+   default:
+      cqe->status = -EINVAL;
+   }
+}
+
+static u32 ht530_ring_sq_pending(struct ht530_ring *r){   /// SQEs userspace has posted that we haven't consumed
+   u32 n = smp_load_acquire(&r->hdr->sq_tail) - r->sq_head;
+   return min(n, r->sq_mask + 1);
+}
+
+static u32 ht530_ring_cq_ready(struct ht530_ring *r){   /// CQEs posted that userspace hasn't consumed
+   u32 n = r->cq_tail - READ_ONCE(r->hdr->cq_head);
+   return min(n, r->cq_mask + 1);
+}
+
+static u32 ht530_ring_drain(struct ht530_ring *r, u32 max){   /// run up to max SQEs, as far as CQ space allows
+   struct ht530_sqe sqe;
+   u32 n, i;
+
+   mutex_lock(&r->lock);
+   // cq_head is read with acquire so we don't overwrite CQEs userspace is still reading
+   n = min3(max, ht530_ring_sq_pending(r),
+            r->cq_mask + 1 - min(r->cq_tail - smp_load_acquire(&r->hdr->cq_head), r->cq_mask + 1));
+   for (i = 0; i < n; i++) {
+      sqe = r->sqes[(r->sq_head + i) & r->sq_mask];   // copy: userspace may scribble on the slot meanwhile
+      ht530_ring_exec(r, &sqe, &r->cqes[(r->cq_tail + i) & r->cq_mask]);
+   }
+   if (n) {
+      r->sq_head += n;
+      r->cq_tail += n;
+      smp_store_release(&r->hdr->sq_head, r->sq_head);
+      smp_store_release(&r->hdr->cq_tail, r->cq_tail);   // CQE contents become visible with the tail
+      if (waitqueue_active(&r->cq_wait))
+         wake_up(&r->cq_wait);
+   }
+   mutex_unlock(&r->lock);
+   return n;
+}
+
+static int ht530_ring_sqpoll(void *data){   /// HT530_RING_SQPOLL: serve the SQ until the ring goes away
+   struct ht530_ring *r = data;
+   unsigned long idle_end = jiffies + r->sq_idle;
+
+   unsigned int n;
+
+   while (!kthread_should_stop()) {
+      memalloc_use_memcg(r->memcg);   // entries it stores are the creator's, as if put with ENTER
+      n = ht530_ring_drain(r, r->sq_mask + 1);
+      memalloc_unuse_memcg();
+      if (n) {
+         idle_end = jiffies + r->sq_idle;
+         cond_resched();
+         continue;
+      }
+      if (time_before(jiffies, idle_end)) {
+         cpu_relax();
+         cond_resched();
+         continue;
+      }
+      // Idle: advertise that we need a HT530_ENTER_SQ_WAKEUP, then look once more before sleeping
+      set_current_state(TASK_INTERRUPTIBLE);
+      WRITE_ONCE(r->hdr->flags, r->hdr->flags | HT530_RING_NEED_WAKEUP);
+      smp_mb();   // pairs with userspace's barrier between storing sq_tail and reading flags
+      if (!ht530_ring_sq_pending(r) && !kthread_should_stop())
+         schedule();
+      __set_current_state(TASK_RUNNING);
+      WRITE_ONCE(r->hdr->flags, r->hdr->flags & ~HT530_RING_NEED_WAKEUP);
+      idle_end = jiffies + r->sq_idle;
+   }
+   return 0;
+}
+
+static void ht530_ring_free(struct ht530_ring *r){
+   if (r->sq_thread) {
+      kthread_stop(r->sq_thread);
+      put_task_struct(r->sq_thread);
+      atomic_dec(&ht530_sqpoll_nr);
+   }
+   if (r->spare)
+      ht530_entry_free(r->spare);
+   mem_cgroup_put(r->memcg);
+   vfree(r->hdr);
+   kfree(r);
+}
+
+static long ht530_ioctl_ring_setup(struct ht530_file *hf, struct ht530_ring_params __user *uparams){
+   struct ht530_ring_params p;
+   struct ht530_ring *r;
+   struct task_struct *t;
+   size_t sq_off, cq_off, size;
+
+   if (copy_from_user(&p, uparams, sizeof(p)))
+      return -EFAULT;
+   if (!p.cq_entries)
+      p.cq_entries = 2 * p.sq_entries;
+   if (!is_power_of_2(p.sq_entries) || p.sq_entries > 32768 ||
+       !is_power_of_2(p.cq_entries) || p.cq_entries < p.sq_entries || p.cq_entries > 65536 ||
+       (p.flags & ~HT530_RING_SQPOLL))
+      return -EINVAL;
+   if (p.flags & HT530_RING_SQPOLL) {   // a kernel thread that spins, maybe pinned to a CPU: privileged, as in io_uring
+      if (!capable(CAP_SYS_ADMIN))
+         return -EPERM;
+      if (p.sq_idle_ms > sq_idle_max_ms)
+         return -EINVAL;
+      if (p.sq_cpu >= 0 && (p.sq_cpu >= nr_cpu_ids || !cpu_online(p.sq_cpu)))
+         return -EINVAL;
+   }
+
+   sq_off = ALIGN(sizeof(struct ht530_ring_hdr), SMP_CACHE_BYTES);
+   cq_off = ALIGN(sq_off + p.sq_entries * sizeof(struct ht530_sqe), SMP_CACHE_BYTES);
+   size = PAGE_ALIGN(cq_off + p.cq_entries * sizeof(struct ht530_cqe));
+
+   r = kzalloc(sizeof(*r), GFP_KERNEL_ACCOUNT);
+   if (!r)
+      return -ENOMEM;
+   r->hdr = __vmalloc(size, GFP_KERNEL_ACCOUNT | __GFP_ZERO, PAGE_KERNEL);   // vmalloc_user can't be charged
+   if (!r->hdr) {
+      kfree(r);
+      return -ENOMEM;
+   }
+   r->memcg = get_mem_cgroup_from_mm(current->mm);   // NULL without memcg
+   r->table = hf->table;
+   r->sqes = (void *)r->hdr + sq_off;
+   r->cqes = (void *)r->hdr + cq_off;
+   r->map_size = size;
+   r->sq_mask = p.sq_entries - 1;
+   r->cq_mask = p.cq_entries - 1;
+   r->hdr->sq_entries = p.sq_entries;
+   r->hdr->cq_entries = p.cq_entries;
+   r->sq_idle = msecs_to_jiffies(p.sq_idle_ms ? p.sq_idle_ms : sq_idle_max_ms);
+   mutex_init(&r->lock);
+   init_waitqueue_head(&r->cq_wait);
+
+   mutex_lock(&hf->lock);
+   if (hf->ring) {   // one ring per fd
+      mutex_unlock(&hf->lock);
+      ht530_ring_free(r);
+      return -EBUSY;
+   }
+   if (p.flags & HT530_RING_SQPOLL) {
+      if (atomic_inc_return(&ht530_sqpoll_nr) > READ_ONCE(sqpoll_max)) {
+         atomic_dec(&ht530_sqpoll_nr);
+         mutex_unlock(&hf->lock);
+         ht530_ring_free(r);
+         return -EAGAIN;
+      }
+      t = kthread_create(ht530_ring_sqpoll, r, "ht530-sqpoll");
+      if (IS_ERR(t)) {
+         atomic_dec(&ht530_sqpoll_nr);
+         mutex_unlock(&hf->lock);
+         ht530_ring_free(r);
+         return PTR_ERR(t);
+      }
+      if (p.sq_cpu >= 0)
+         kthread_bind(t, p.sq_cpu);
+      get_task_struct(t);   // the thread may exit on its own only via kthread_stop, keep it until then
+      r->sq_thread = t;
+      wake_up_process(t);
+   }
+   smp_store_release(&hf->ring, r);   // the lockless readers below see it set up or not at all
+   mutex_unlock(&hf->lock);
+
+   p.sq_off = sq_off;
+   p.cq_off = cq_off;
+   p.map_size = size;
+   if (copy_to_user(uparams, &p, sizeof(p)))
+      return -EFAULT;   // the ring stays set up; userspace can still find it by mapping map_size
+   return 0;
+}
+
+static long ht530_ioctl_ring_enter(struct ht530_file *hf, struct ht530_ring_enter __user *uenter){
+   struct ht530_ring_enter e;
+   struct ht530_ring *r = smp_load_acquire(&hf->ring);
+   long ret = 0;
+
+   if (!r)
+      return -ENXIO;
+   if (copy_from_user(&e, uenter, sizeof(e)))
+      return -EFAULT;
+
+   e.submitted = 0;
+   if (r->sq_thread) {
+      if (e.flags & HT530_ENTER_SQ_WAKEUP)
+         wake_up_process(r->sq_thread);
+   } else if (e.to_submit) {
+      e.submitted = ht530_ring_drain(r, e.to_submit);
+   }
+   if ((e.flags & HT530_ENTER_GETEVENTS) && e.min_complete)
+      ret = wait_event_interruptible(r->cq_wait,
+                                     ht530_ring_cq_ready(r) >= min(e.min_complete, r->cq_mask + 1));
+
+   if (put_user(e.submitted, &uenter->submitted))
+      return -EFAULT;
+   return ret;
+}
+
+/*
+ * HT530_WATCH readers. The reader copies straight out of the ring without holding watch_lock:
+ * writers only ever append past head and never catch up with tail, so [tail, head) stays put until
+ * the reader moves tail on.
+ */
+#define watch_size_min  (128 * 1024)         /// holds a change of the largest key and value
+#define watch_size_max  (64 * 1024 * 1024)
+
+static bool ht530_watch_ready(struct ht530_watcher *w){   /// something for the reader
+   return READ_ONCE(w->head) != READ_ONCE(w->tail) || READ_ONCE(w->lost);
+}
+
+static void ht530_watch_free(struct ht530_table *t, struct ht530_watcher *w){
+   spin_lock(&t->watch_lock);
+   list_del(&w->node);
+   spin_unlock(&t->watch_lock);
+   mutex_destroy(&w->read_lock);
+   kvfree(w->keys);
+   kvfree(w->buf);
+   kfree(w);
+}
+
+/// Copy in and check HT530_WATCH's key records; the lengths are read twice, so check the copy.
+static long ht530_watch_keys(struct ht530_watcher *w, const u8 __user *ukeys, u32 nkeys){
+   struct ht530_rec rec;
+   size_t len = 0, off;
+   u32 i;
+
+   for (i = 0; i < nkeys; i++) {
+      if (copy_from_user(&rec, ukeys + len, sizeof(rec)))
+         return -EFAULT;
+      if (!rec.klen || rec.klen > HT530_KEY_MAX || rec.vlen)
+         return -EINVAL;
+      len += HT530_REC_SIZE(rec.klen, 0);
+   }
+   w->keys = kvmalloc(len, GFP_KERNEL_ACCOUNT);
+   if (!w->keys)
+      return -ENOMEM;
+   if (copy_from_user(w->keys, ukeys, len))
+      return -EFAULT;
+   for (i = 0, off = 0; i < nkeys; i++) {
+      memcpy(&rec, w->keys + off, sizeof(rec));
+      if (!rec.klen || rec.klen > HT530_KEY_MAX || rec.vlen || off + HT530_REC_SIZE(rec.klen, 0) > len)
+         return -EINVAL;   // changed under us
+      off += HT530_REC_SIZE(rec.klen, 0);
+   }
+   w->nkeys = nkeys;
+   return 0;
+}
+
+static long ht530_ioctl_watch(struct ht530_file *hf, struct ht530_watch __user *uwatch){
+   struct ht530_table *t = hf->table;
+   struct ht530_watch wa;
+   struct ht530_watcher *w;
+   long ret = 0;
+
+   if (copy_from_user(&wa, uwatch, sizeof(wa)))
+      return -EFAULT;
+   if (wa.nkeys > HT530_WATCH_KEYS_MAX)
+      return -EINVAL;
+   w = kzalloc(sizeof(*w), GFP_KERNEL);
+   if (!w)
+      return -ENOMEM;
+   INIT_LIST_HEAD(&w->node);
+   mutex_init(&w->read_lock);
+   init_waitqueue_head(&w->wait);
+   w->size = roundup_pow_of_two(clamp_t(u32, wa.size ? wa.size : 256 * 1024, watch_size_min, watch_size_max));
+   w->buf = kvmalloc(w->size, GFP_KERNEL_ACCOUNT);   // sized by the caller, so charged to it
+   if (!w->buf)
+      ret = -ENOMEM;
+   else if (wa.nkeys)
+      ret = ht530_watch_keys(w, u64_to_user_ptr(wa.keys), wa.nkeys);
+
+   mutex_lock(&hf->lock);
+   if (!ret && hf->watch)
+      ret = -EBUSY;
+   if (!ret) {
+      spin_lock(&t->watch_lock);
+      list_add_tail(&w->node, &t->watchers);
+      spin_unlock(&t->watch_lock);
+      smp_store_release(&hf->watch, w);   // as hf->ring: readers take it without hf->lock
+   }
+   mutex_unlock(&hf->lock);
+   if (ret)
+      ht530_watch_free(t, w);   // never listed: list_del of the bare node is harmless
+   return ret;
+}
+
+static ssize_t ht530_watch_read(struct ht530_table *t, struct ht530_watcher *w, char __user *buf, size_t len,
+                                bool nonblock){   /// whole change records, as many as fit in len
+   struct ht530_change c;
+   u64 head, tail, end;
+   size_t off, n;
+   ssize_t ret = 0;
+
+   if (mutex_lock_interruptible(&w->read_lock))
+      return -ERESTARTSYS;
+   for (;;) {
+      spin_lock(&t->watch_lock);
+      if (w->head == w->tail && w->lost) {   // drained after an overflow and nothing new came: report it now
+         c = (struct ht530_change){ .seq = w->lost_seq, .op = HT530_CHANGE_OVERFLOW };
+         ht530_watch_copy(w, &c, sizeof(c));
+         w->lost = 0;
+      }
+      head = w->head;
+      tail = w->tail;
+      spin_unlock(&t->watch_lock);
+      if (head != tail)
+         break;
+      ret = nonblock ? -EAGAIN : wait_event_interruptible(w->wait, ht530_watch_ready(w));
+      if (ret) {
+         mutex_unlock(&w->read_lock);
+         return ret;
+      }
+   }
+
+   for (end = tail; end != head; end += n) {
+      off = end & (w->size - 1);
+      n = min_t(size_t, sizeof(c), w->size - off);   // records are 8-byte aligned, but the header may still wrap
+      memcpy(&c, w->buf + off, n);
+      memcpy((u8 *)&c + n, w->buf, sizeof(c) - n);
+      n = HT530_CHANGE_SIZE(c.klen, c.vlen);
+      if (end - tail + n > len)
+         break;
+   }
+   if (end == tail) {
+      ret = -EINVAL;   // len is too small for the next record
+   } else {
+      off = tail & (w->size - 1);
+      n = min_t(size_t, end - tail, w->size - off);
+      if (copy_to_user(buf, w->buf + off, n) || copy_to_user(buf + n, w->buf, end - tail - n))
+         ret = -EFAULT;
+   }
+   if (!ret) {
+      spin_lock(&t->watch_lock);
+      w->tail = end;
+      spin_unlock(&t->watch_lock);
+      ret = end - tail;
+   }
+   mutex_unlock(&w->read_lock);
+   return ret;
+}
+
+static __poll_t dev_poll(struct file *filep, poll_table *wait){
+   struct ht530_file *hf = filep->private_data;
+   struct ht530_watcher *w = smp_load_acquire(&hf->watch);
+
+   if (!w)
+      return DEFAULT_POLLMASK;   // lookups and writes never wait
+   poll_wait(filep, &w->wait, wait);
+   return EPOLLOUT | EPOLLWRNORM | (ht530_watch_ready(w) ? EPOLLIN | EPOLLRDNORM : 0);
+}
+
+/*
+ * The view belongs to the table, which the fd keeps alive, and the mapping keeps the file open, so
+ * it can't be freed while mapped. Read-only for good: VM_MAYWRITE goes too, so mprotect can't undo it.
+ */
+static int ht530_view_mmap(struct ht530_table *t, struct vm_area_struct *vma){
+   if (!t->view)
+      return -ENXIO;
+   if (vma->vm_flags & VM_WRITE)
+      return -EACCES;
+   if (vma->vm_end - vma->vm_start > t->view_size)
+      return -EINVAL;
+   vma->vm_flags &= ~VM_MAYWRITE;
+   vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+   return remap_vmalloc_range(vma, t->view, 0);
+}
+
+/*
+ * Ring memory comes from __vmalloc, not vmalloc_user, so that it is charged: remap_vmalloc_range only
+ * takes VM_USERMAP areas, so its pages go in one at a time instead, as that would do.
+ */
+static int ht530_ring_mmap(struct ht530_ring *r, struct vm_area_struct *vma){
+   unsigned long off;
+   int ret;
+
+   vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+   for (off = 0; off < vma->vm_end - vma->vm_start; off += PAGE_SIZE) {
+      ret = vm_insert_page(vma, vma->vm_start + off, vmalloc_to_page((void *)r->hdr + off));
+      if (ret)
+         return ret;
+   }
+   return 0;
+}
+
+static int dev_mmap(struct file *filep, struct vm_area_struct *vma){   /// map the fd's rings, or its table's view
+   struct ht530_file *hf = filep->private_data;
+   struct ht530_ring *r = smp_load_acquire(&hf->ring);
+
+   if (vma->vm_pgoff == HT530_VIEW_OFFSET >> PAGE_SHIFT)
+      return ht530_view_mmap(hf->table, vma);
+   if (!r)
+      return -ENXIO;
+   if (vma->vm_pgoff || vma->vm_end - vma->vm_start > r->map_size)
+      return -EINVAL;
+   return ht530_ring_mmap(r, vma);
+}
+
+/*
+ * Telemetry under /sys/kernel/debug/ht530/<table id>:
+ *   stats   operation counters, entry count, bucket count and memory in use (cheap, no table walk)
+ *   chains  chain-length histogram and longest chain, from a live walk of every bucket
+ *   bloom   size, fill and false-positive rate of the Bloom filter, estimated and observed (bloom_bits)
+ *   latency lock-wait and work time histograms per operation (profile)
+ *   hot     hottest sampled keys and keys waited on most, with their chain lengths (profile)
+ */
+static struct dentry *ht530_debugfs;
+
+#define chain_hist_max  32   /// chains of this length or longer share the last histogram slot
+
+static const char * const ht530_stat_names[HT530_NR_STATS] = {
+   "gets", "hits", "misses", "inserts", "replaces", "deletes", "dumps", "contended",
+   "evictions", "expired", "reseeds", "reclaimed", "idle_drops", "bloom_skips", "bloom_fps",
+};
+
+static size_t ht530_bucket_table_bytes(const struct ht530_bucket_table *tbl){
+   return struct_size(tbl, buckets, 1UL << tbl->nbits) + (tbl->lock_mask + 1) * sizeof(*tbl->locks);
+}
+
+static int ht530_stats_show(struct seq_file *m, void *v){
+   struct ht530_table *t = m->private;
+   u64 sum[HT530_NR_STATS] = { 0 };
+   struct ht530_bucket_table *tbl, *future;
+   struct ht530_oa_table *oa;
+   unsigned int i, cpu, nbuckets;
+   s64 nelems = percpu_counter_sum_positive(&t->nelems);
+   size_t bytes;
+
+   for_each_possible_cpu(cpu) {
+      u64 *c = (u64 *)per_cpu_ptr(t->stats, cpu);
+      for (i = 0; i < HT530_NR_STATS; i++)
+         sum[i] += READ_ONCE(c[i]);
+   }
+   for (i = 0; i < HT530_NR_STATS; i++)
+      seq_printf(m, "%-10s %llu\n", ht530_stat_names[i], sum[i]);
+
+   // entries are counted at their size class plus out-of-line values, bucket arrays with their lock stripes
+   bytes = percpu_counter_sum_positive(&t->mem);
+   rcu_read_lock();
+   if (t->open) {   // no entries, just the bucket array
+      oa = rcu_dereference(t->oa);
+      nbuckets = 1U << oa->nbits;
+      bytes += (sizeof(*oa->buckets) << oa->nbits) + (oa->lock_mask + 1) * sizeof(*oa->locks);
+   } else {
+      tbl = rcu_dereference(t->tbl);
+      nbuckets = 1U << tbl->nbits;
+      bytes += ht530_bucket_table_bytes(tbl);
+      future = rcu_dereference(tbl->future);
+      if (future)
+         bytes += ht530_bucket_table_bytes(future);
+   }
+   rcu_read_unlock();
+
+   seq_printf(m, "%-10s %lld\n", "entries", nelems);
+   seq_printf(m, "%-10s %u\n", "buckets", nbuckets);
+   seq_printf(m, "%-10s %zu\n", "bytes", bytes);
+   return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ht530_stats);
+
+static int ht530_oa_chains_show(struct seq_file *m, struct ht530_table *t){   /// open addressing: how far keys sit from their home bucket
+   unsigned long hist[chain_hist_max + 1] = { 0 };
+   struct ht530_oa_table *oa;
+   struct ht530_oa_bucket *bk;
+   unsigned int b, i, mask, dist, max_dist = 0;
+   u64 ctrl, kv;
+   int key;
+
+   // oa_rwsem keeps resizes out so oa stays put while we reschedule; writers go on meanwhile
+   percpu_down_read(&t->oa_rwsem);
+   oa = rcu_dereference_protected(t->oa, 1);
+   mask = (1U << oa->nbits) - 1;
+   for (b = 0; b <= mask; b++) {
+      bk = &oa->buckets[b];
+      ctrl = READ_ONCE(bk->ctrl);
+      for (i = 0; i < oa_slots; i++) {
+         if (!((ctrl >> (8 * i)) & 0x80))
+            continue;
+         kv = READ_ONCE(bk->slot[i]);
+         key = (int)(u32)kv;
+         dist = (b - ht530_oa_home(oa, ht530_hash(&oa->key, &key, sizeof(key)))) & mask;
+         hist[min_t(unsigned int, dist, chain_hist_max)]++;
+         max_dist = max(max_dist, dist);
+      }
+      if ((b & 1023) == 1023)
+         cond_resched();
+   }
+   percpu_up_read(&t->oa_rwsem);
+
+   seq_printf(m, "buckets %u slots %u max_probe %u\n", mask + 1, (mask + 1) * oa_slots, max_dist);
+   for (i = 0; i <= chain_hist_max; i++) {
+      if (hist[i])
+         seq_printf(m, "%s%-4u %lu\n", i == chain_hist_max ? ">=" : "  ", i, hist[i]);
+   }
+   return 0;
+}
+
+static int ht530_chains_show(struct seq_file *m, void *v){
+   struct ht530_table *t = m->private;
+   unsigned long hist[chain_hist_max + 1] = { 0 };
+   struct ht530_bucket_table *tbl;
+   struct ht_entry *e;
+   struct hlist_node *n;
+   unsigned int bkt, len, max_len = 0, i;
+
+   if (t->open)
+      return ht530_oa_chains_show(m, t);
+   // Holding resize_mutex pins the generation, so the walk can drop RCU between chunks of buckets
+   // and reschedule; chains themselves are read locklessly and may change under the walk.
+   mutex_lock(&t->resize_mutex);
+   tbl = rcu_dereference_protected(t->tbl, lockdep_is_held(&t->resize_mutex));
+   for (bkt = 0; bkt < (1U << tbl->nbits); ) {
+      rcu_read_lock();
+      do {
+         len = 0;
+         ht530_for_each_entry(e, n, &tbl->buckets[bkt], tbl->gen)
+            len++;
+         hist[min_t(unsigned int, len, chain_hist_max)]++;
+         max_len = max(max_len, len);
+      } while (++bkt % 1024 && bkt < (1U << tbl->nbits));
+      rcu_read_unlock();
+      cond_resched();
+   }
+   mutex_unlock(&t->resize_mutex);
+
+   seq_printf(m, "buckets %u max_chain %u\n", 1U << tbl->nbits, max_len);
+   for (i = 0; i <= chain_hist_max; i++) {
+      if (hist[i])
+         seq_printf(m, "%s%-4u %lu\n", i == chain_hist_max ? ">=" : "  ", i, hist[i]);
+   }
+   return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ht530_chains);
+
+static int ht530_bloom_show(struct seq_file *m, void *v){
+   struct ht530_table *t = m->private;
+   u64 skips = 0, fps = 0, nonzero = 0, sum = 0, est, seen;
+   unsigned long b, nblocks = (1UL << t->bloom_bits) / bloom_block;
+   unsigned int i, nz;
+   int cpu;
+
+   for_each_possible_cpu(cpu) {
+      skips += READ_ONCE(per_cpu_ptr(t->stats, cpu)->bloom_skips);
+      fps += READ_ONCE(per_cpu_ptr(t->stats, cpu)->bloom_fps);
+   }
+   // a key of a block whose counters are a fraction f nonzero gets through with probability f^bloom_k
+   for (b = 0; b < nblocks; b++) {
+      for (i = nz = 0; i < bloom_block; i++)
+         nz += !!ht530_bloom_counter(t->bloom + b * (bloom_block / 4), i);
+      nonzero += nz;
+      sum += (u64)nz * nz * nz * nz;
+      if ((b & 1023) == 1023)
+         cond_resched();
+   }
+   est = div64_u64(sum, nblocks) * 1000000 >> 24;   // ppm, bloom_block^bloom_k = 2^24
+   seen = skips + fps ? div64_u64(fps * 1000000, skips + fps) : 0;
+
+   seq_printf(m, "counters   %lu\n", 1UL << t->bloom_bits);
+   seq_printf(m, "hashes     %u\n", bloom_k);
+   seq_printf(m, "nonzero    %llu\n", nonzero);
+   seq_printf(m, "fp_est_ppm %llu\n", est);
+   seq_printf(m, "fp_ppm     %llu\n", seen);   // of the misses, how many the filter let through
+   return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ht530_bloom);
+
+static const char * const ht530_lat_names[lat_nr_ops] = { "get", "put", "del", "dump", "open" };
+
+static int ht530_latency_show(struct seq_file *m, void *v){
+   struct ht530_table *t = m->private;
+   u64 hist[2][lat_slots], n[2];
+   struct ht530_lat *l;
+   unsigned int op, k, i;
+   int cpu;
+
+   for (op = 0; op < lat_nr_ops; op++) {
+      memset(hist, 0, sizeof(hist));
+      memset(n, 0, sizeof(n));
+      for_each_possible_cpu(cpu) {
+         l = per_cpu_ptr(t->lat, cpu);
+         for (i = 0; i < lat_slots; i++) {
+            hist[0][i] += READ_ONCE(l->wait[op][i]);
+            hist[1][i] += READ_ONCE(l->work[op][i]);
+         }
+      }
+      for (i = 0; i < lat_slots; i++) {
+         n[0] += hist[0][i];
+         n[1] += hist[1][i];
+      }
+      if (!n[1])
+         continue;
+      for (k = 0; k < 2; k++) {   // slot i is [2^i, 2^(i+1)) ns, printed as its lower bound
+         seq_printf(m, "%s %s n=%llu\n", ht530_lat_names[op], k ? "work" : "wait", n[k]);
+         for (i = 0; i < lat_slots; i++) {
+            if (hist[k][i])
+               seq_printf(m, "  %s%-11llu %llu\n", i == lat_slots - 1 ? ">=" : "  ", i ? 1ULL << i : 0, hist[k][i]);
+         }
+      }
+   }
+   return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ht530_latency);
+
+static int ht530_hot_chain(struct ht530_table *t, const struct ht530_hot_key *k){   /// length of k's chain, -1 if unknown
+   struct ht530_bucket_table *tbl;
+   struct ht_entry *e;
+   struct hlist_node *n;
+   int len = 0;
+   u32 hash;
+
+   if (t->open || k->klen > hot_key_max)
+      return -1;   // no chains, or not the whole key
+   rcu_read_lock();
+   tbl = rcu_dereference(t->tbl);
+   hash = ht530_hash(&tbl->key, k->key, k->klen);
+   ht530_for_each_entry(e, n, &tbl->buckets[ht530_bucket(tbl, hash)], tbl->gen)
+      len++;
+   rcu_read_unlock();
+   return len;
+}
+
+static int ht530_hot_show(struct seq_file *m, void *v){
+   struct ht530_table *t = m->private;
+   struct ht530_hot_key top[hot_top], k;
+   unsigned int h, i, j;
+
+   for (h = 0; h < 2; h++) {
+      spin_lock(&t->hot[h].lock);
+      memcpy(top, t->hot[h].top, sizeof(top));
+      spin_unlock(&t->hot[h].lock);
+      for (i = 1; i < hot_top; i++) {   // hottest first
+         k = top[i];
+         for (j = i; j > 0 && top[j - 1].count < k.count; j--)
+            top[j] = top[j - 1];
+         top[j] = k;
+      }
+      if (h == hot_ops)
+         seq_printf(m, "operations, 1 in %u sampled, counts scaled up:\n", hot_sample);
+      else
+         seq_puts(m, "bucket lock waits:\n");
+      for (i = 0; i < hot_top && top[i].count; i++) {
+         if (top[i].klen == sizeof(int))
+            seq_printf(m, "  %-34d", *(int *)top[i].key);
+         else   // hex, ... if there was more of it
+            seq_printf(m, "  %*phN%-*s", min_t(int, top[i].klen, hot_key_max), top[i].key,
+                       34 - 2 * min_t(int, top[i].klen, hot_key_max), top[i].klen > hot_key_max ? "..." : "");
+         seq_printf(m, " %-12llu chain %d\n", (u64)top[i].count * (h == hot_ops ? hot_sample : 1),
+                    ht530_hot_chain(t, &top[i]));
+      }
+   }
+   return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ht530_hot);
+
+static void ht530_debugfs_add(struct ht530_table *t){   /// failures are not fatal, the table works without telemetry
+   char name[12];
+
+   snprintf(name, sizeof(name), "%u", t->id);
+   t->debugfs = debugfs_create_dir(name, ht530_debugfs);
+   debugfs_create_file("stats", 0444, t->debugfs, t, &ht530_stats_fops);
+   debugfs_create_file("chains", 0444, t->debugfs, t, &ht530_chains_fops);
+   if (t->bloom)
+      debugfs_create_file("bloom", 0444, t->debugfs, t, &ht530_bloom_fops);
+   debugfs_create_file("latency", 0444, t->debugfs, t, &ht530_latency_fops);
+   debugfs_create_file("hot", 0444, t->debugfs, t, &ht530_hot_fops);
+   // the budget can be resized live; lowering it takes effect on the next insert
+   debugfs_create_u64("max_entries", 0644, t->debugfs, &t->max_entries);
+   debugfs_create_u64("max_bytes", 0644, t->debugfs, &t->max_bytes);
+   debugfs_create_u32("default_ttl_ms", 0644, t->debugfs, &t->default_ttl_ms);
+   debugfs_create_u32("chain_max", 0644, t->debugfs, &t->chain_max);
+}
+
+static int     dev_open(struct inode *, struct file *);
+static int     dev_release(struct inode *, struct file *);
+static ssize_t dev_read(struct file *, char *, size_t, loff_t *);
+static ssize_t dev_write(struct file *, const char *, size_t, loff_t *);
+static long dev_ioctl(struct file *, unsigned int , unsigned long );    // special i/o func 
+
+static struct file_operations fops =
+{
+   .owner = THIS_MODULE,   // open fds pin the module, and with it the tables they reference
+   .open = dev_open,
+   .read = dev_read,
+   .write = dev_write,
+   .release = dev_release,
+   .unlocked_ioctl	= dev_ioctl,
+   .mmap = dev_mmap,
+   .poll = dev_poll,
+};
+
+
+/*
+ * Table lifecycle. A table is built (buckets, counters) before anything can see it, then, all under
+ * ht530_tables_lock, its id is reserved, its device node and debugfs directory are created and only
+ * then is it published in ht530_tables. Removing it deletes the node and the directory before the
+ * id is given back, under the same lock, so a create reusing the id never meets the old names. The
+ * memory goes when the last fd that had it open is closed.
+ */
+static void ht530_table_release(struct kref *ref){
+   ht530_table_free(container_of(ref, struct ht530_table, ref));
+}
+
+/// Create table info->id (any free id from 1 up if < 0); a 0 field means the module parameter's value.
+static struct ht530_table *ht530_table_create(const struct ht530_table_info *info){
+   int id = info->id;
+   struct ht530_table *t;
+   int ret;
+
+   t = ht530_table_new(info);
+   if (IS_ERR(t))
+      return t;
+
+   mutex_lock(&ht530_tables_lock);
+   if (id < 0)   // reserved, not yet published: opens of the id find nothing until idr_replace
+      ret = idr_alloc(&ht530_tables, NULL, 1, HT530_MAX_TABLES, GFP_KERNEL);
+   else
+      ret = idr_alloc(&ht530_tables, NULL, id, id + 1, GFP_KERNEL);
+   if (ret < 0){
+      mutex_unlock(&ht530_tables_lock);
+      ht530_table_free(t);
+      return ERR_PTR(ret == -ENOSPC && id >= 0 ? -EEXIST : ret);
+   }
+   t->id = ret;
+
+   if (t->id)
+      t->dev = device_create(ht530Class, NULL, MKDEV(majorNumber, t->id), t, DEVICE_NAME "-%u", t->id);
+   else
+      t->dev = device_create(ht530Class, NULL, MKDEV(majorNumber, 0), t, DEVICE_NAME);
+   if (IS_ERR(t->dev)){
+      ret = PTR_ERR(t->dev);
+      idr_remove(&ht530_tables, t->id);
+      mutex_unlock(&ht530_tables_lock);
+      ht530_table_free(t);   // never published, so nobody opened it
+      return ERR_PTR(ret);
+   }
+   ht530_debugfs_add(t);
+   idr_replace(&ht530_tables, t, t->id);
+   mutex_unlock(&ht530_tables_lock);
+   printk(KERN_INFO "ht530: table %u created with %u buckets\n", t->id, 1U << t->init_bits);
+   return t;
+}
+
+static void ht530_table_remove(struct ht530_table *t){   /// under ht530_tables_lock: node, debugfs, then the id
+   device_destroy(ht530Class, MKDEV(majorNumber, t->id));
+   debugfs_remove_recursive(t->debugfs);
+   idr_remove(&ht530_tables, t->id);
+   kref_put(&t->ref, ht530_table_release);
+}
+
+static void ht530_tables_remove_all(void){
+   struct ht530_table *t;
+   int id;
+
+   mutex_lock(&ht530_tables_lock);
+   idr_for_each_entry(&ht530_tables, t, id)
+      ht530_table_remove(t);
+   mutex_unlock(&ht530_tables_lock);
+   idr_destroy(&ht530_tables);
+}
+
+
+static int __init ht530_init(void){
+   struct ht530_table_info info = {   // module defaults
+      .flags = (ordered ? HT530_TABLE_ORDERED : 0) | (cache ? HT530_TABLE_CACHE : 0),
+   };
+   struct ht530_table *t;
+   unsigned int i;
+   int ret;
+
+   printk(KERN_INFO "ht530: Initializing the ht530 LKM\n");
+
+   ntables = clamp_t(unsigned int, ntables, 1, HT530_MAX_TABLES);
+   ret = ht530_core_init();
+   if (ret)
+      return ret;
+
+   // Try to dynamically allocate a major number for the device -- more difficult but worth it
+   // (register_chrdev reserves minors 0-255 for us, one per table)
+   majorNumber = register_chrdev(0, DEVICE_NAME, &fops);
+   if (majorNumber<0){
+      ht530_core_exit();
+      printk(KERN_ALERT "ht530 failed to register a major number\n");
+      return majorNumber;
+   }
+   printk(KERN_INFO "ht530: registered correctly with major number %d\n", majorNumber);
+
+   // Register the device class
+   ht530Class = class_create(THIS_MODULE, CLASS_NAME);
+   if (IS_ERR(ht530Class)){                // Check for error and clean up if there is
+      unregister_chrdev(majorNumber, DEVICE_NAME);
+      ht530_core_exit();
+      printk(KERN_ALERT "Failed to register device class\n");
+      return PTR_ERR(ht530Class);          // Correct way to return an error on a pointer
+   }
+   printk(KERN_INFO "ht530: device class registered correctly\n");
+
+   ht530_debugfs = debugfs_create_dir(DEVICE_NAME, NULL);
+
+   // Create the tables, each one's device node appears once it is ready
+   for (i = 0; i < ntables; i++){
+      info.id = i;
+      t = ht530_table_create(&info);
+      if (IS_ERR(t)){               // Clean up if there is an error
+         ht530_tables_remove_all();           // Repeated code but the alternative is goto statements
+         debugfs_remove_recursive(ht530_debugfs);
+         class_destroy(ht530Class);
+         unregister_chrdev(majorNumber, DEVICE_NAME);
+         ht530_core_exit();
+         printk(KERN_ALERT "Failed to create table %u\n", i);
+         return PTR_ERR(t);
+      }
+   }
+   printk(KERN_INFO "ht530: device class created correctly\n"); // Made it! device was initialized
+
+   return 0;
+}
+
+
+static void __exit ht530_exit(void){
+   ht530_tables_remove_all();                             // remove the devices and free the tables
+   debugfs_remove_recursive(ht530_debugfs);
+   class_unregister(ht530Class);                          // unregister the device class
+   class_destroy(ht530Class);                             // remove the device class
+   unregister_chrdev(majorNumber, DEVICE_NAME);             // unregister the major number
+   ht530_core_exit();                                     // pending frees, then the entry caches
+   
+   printk(KERN_INFO "ht530: Goodbye from the ht530 LKM!\n");
+}
+
+
+static int dev_open(struct inode *inodep, struct file *filep){
+   // No device-wide lock: every read/write/ioctl takes only the lock stripe of the bucket it touches,
+   // so any number of processes/threads can hold the device open and operate concurrently.
+   struct ht530_table *t;
+   u64 start = ht530_lat_start(), wait = 0;
+   struct ht530_file *hf = kzalloc(sizeof(*hf), GFP_KERNEL);
+   if (!hf)
+      return -ENOMEM;
+
+   // the minor picks the table; keep it alive for this fd even if it is destroyed meanwhile
+   mutex_lock(&ht530_tables_lock);
+   if (start)
+      wait = ktime_get_ns() - start;   // includes the allocation above, which is no lock wait
+   t = idr_find(&ht530_tables, iminor(inodep));
+   if (t)
+      kref_get(&t->ref);
+   mutex_unlock(&ht530_tables_lock);
+   if (!t){
+      kfree(hf);
+      return -ENODEV;
+   }
+   hf->table = t;
+   mutex_init(&hf->lock);
+   filep->private_data = hf;
+   if (start)
+      ht530_lat_end(t, lat_open, start, wait);
+   ht530_dbg("Device has been opened %d time(s), table %u\n", atomic_inc_return(&numberOpens), t->id);
+   return 0;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+static ssize_t dev_read(struct file *filep, char *buffer, size_t len, loff_t *offset){
+   struct ht530_file *hf = filep->private_data;
+   struct ht530_watcher *w = smp_load_acquire(&hf->watch);
+
+   if (w)
+      return ht530_watch_read(hf->table, w, buffer, len, filep->f_flags & O_NONBLOCK);
+   return ht530_table_read(hf->table, buffer);
+}
+
+static ssize_t dev_write(struct file *filep, const char *buffer, size_t len, loff_t *offset){
+   struct ht530_file *hf = filep->private_data;
+
+   return ht530_table_write(hf->table, buffer, len);
+}
+
+
+static long ht530_ioctl_table_create(struct ht530_table_info __user *uinfo){
+   struct ht530_table_info info;
+   struct ht530_table *t;
+
+   if (!capable(CAP_SYS_ADMIN))
+      return -EPERM;
+   if (copy_from_user(&info, uinfo, sizeof(info)))
+      return -EFAULT;
+   if (info.id >= HT530_MAX_TABLES)
+      return -EINVAL;
+   t = ht530_table_create(&info);
+   if (IS_ERR(t))
+      return PTR_ERR(t);
+   info.id = t->id;
+   info.init_bits = t->init_bits;
+   info.max_bits = t->max_bits;
+   info.ttl_ms = t->default_ttl_ms;
+   info.max_entries = t->max_entries;
+   info.max_bytes = t->max_bytes;
+   info.flags = (t->ordered ? HT530_TABLE_ORDERED : 0) | (t->cache ? HT530_TABLE_CACHE : 0);
+   if (copy_to_user(uinfo, &info, sizeof(info)))
+      return -EFAULT;   // the table exists regardless; its node shows up as /dev/ht530-<id>
+   return 0;
+}
+
+static long ht530_ioctl_table_destroy(__s32 __user *uid){
+   struct ht530_table *t;
+   s32 id;
+
+   if (!capable(CAP_SYS_ADMIN))
+      return -EPERM;
+   if (get_user(id, uid))
+      return -EFAULT;
+   if (id == 0)
+      return -EBUSY;   // /dev/ht530 lives as long as the module
+   if (id < 0 || id >= HT530_MAX_TABLES)
+      return -EINVAL;
+   mutex_lock(&ht530_tables_lock);
+   t = idr_find(&ht530_tables, id);
+   if (t)
+      ht530_table_remove(t);
+   mutex_unlock(&ht530_tables_lock);
+   return t ? 0 : -ENOENT;
+}
+
+static long dev_ioctl(struct file *file, unsigned int ioctl_num, unsigned long ioctl_param){
+   struct ht530_file *hf = file->private_data;
+
+   switch (ioctl_num) {
+   case HT530_RING_SETUP:
+      return ht530_ioctl_ring_setup(file->private_data, (struct ht530_ring_params __user *)ioctl_param);
+   case HT530_RING_ENTER:
+      return ht530_ioctl_ring_enter(file->private_data, (struct ht530_ring_enter __user *)ioctl_param);
+   case HT530_WATCH:
+      return ht530_ioctl_watch(hf, (struct ht530_watch __user *)ioctl_param);
+   case HT530_TABLE_CREATE:
+      return ht530_ioctl_table_create((struct ht530_table_info __user *)ioctl_param);
+   case HT530_TABLE_DESTROY:
+      return ht530_ioctl_table_destroy((__s32 __user *)ioctl_param);
+   default:
+      return ht530_table_ioctl(hf->table, ioctl_num, ioctl_param);   // everything else is about the table itself
+   }
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+static int dev_release(struct inode *inodep, struct file *filep){
+   struct ht530_file *hf = filep->private_data;
+   if (hf->ring)
+      ht530_ring_free(hf->ring);   // release only runs once every mapping of the rings is gone
+   if (hf->watch)
+      ht530_watch_free(hf->table, hf->watch);
+   mutex_destroy(&hf->lock);
+   kref_put(&hf->table->ref, ht530_table_release);
+   kfree(hf);
+   ht530_dbg("Device successfully closed\n");
+   return 0;
+}
+
+
+module_init(ht530_init);
+module_exit(ht530_exit);
\ No newline at end of file
@@ -0,0 +1,449 @@
+/**
+ * @file   ht530_ioctl.h
+ * @brief   Userspace interface of the ht530 device: record layouts and ioctl numbers
+ *
+ * Shared by the module and by programs that talk to /dev/ht530.
+ */
+
+#ifndef HT530_IOCTL_H
+#define HT530_IOCTL_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+#ifndef __KERNEL__
+#include <stdint.h>
+#endif
+
+struct ht {    // hash table entry struct for user space, read()/write() take one of these
+int key;
+int data;
+};
+
+struct dump_arg      // dump argument struct for ioctl dump
+{
+   int n;// the n-th bucket(in) or n objects retrieved (out)
+   struct ht object_array[8];// to retrieve at most 8 objects from the n-th bucket
+};
+
+#define DUMP _IOWR('d','d',int32_t*)   /// ioctl number for implementining dump cmd via the same
+
+/*
+ * Byte-string keys and values. read()/write(), DUMP, HT530_EXPORT, HT530_BATCH and the rings keep
+ * working on ints: an int key or value is simply a 4-byte one, so key 5 written through write() is
+ * the same entry as the 4-byte key {5,0,0,0} (on little-endian) put through HT530_KV_PUT. Those int
+ * interfaces only see entries whose key and value are both 4 bytes; DUMP and HT530_EXPORT skip the
+ * others (and leave them in place when draining).
+ *
+ * Unlike write(), HT530_KV_PUT stores any value, including an empty one or zeroes; deleting is
+ * HT530_KV_DEL. Entries put through the int interfaces get the table's default TTL.
+ *
+ * With the module loaded with backend=open tables hold ints only: the KV ioctls and HT530_EXPORT fail
+ * with -EOPNOTSUPP, and a put fails with -ENOSPC if the table is full at its largest size.
+ */
+#define HT530_KEY_MAX   1024     ///< longest key, bytes
+#define HT530_VAL_MAX   65536    ///< longest value, bytes
+
+struct ht530_kv {
+   __u64 key;              // user pointer to klen key bytes
+   __u64 val;              // user pointer to the value (put: vlen bytes, get/del: buffer of vlen bytes)
+   __u32 klen;             // 1..HT530_KEY_MAX
+   __u32 vlen;             // put: value length; get/del: in buffer size, out full value length
+   __u32 ttl_ms;           // put: drop the entry this many ms from now, 0 = the table's default TTL
+   __u32 pad;
+};
+
+#define HT530_KV_GET  _IOWR('d','g',struct ht530_kv)   ///< -ENOENT if absent; copies min(vlen, length) bytes
+#define HT530_KV_PUT  _IOW('d','p',struct ht530_kv)    ///< returns 1 if an existing value was replaced, 0 if inserted
+#define HT530_KV_DEL  _IOWR('d','u',struct ht530_kv)   ///< -ENOENT if absent; returns the old value like GET
+
+
+/// Batched access: one ioctl runs a whole array of get/put/delete (and fetch-add/insert) ops
+#define HT530_OP_GET  0   ///< kv.data <- data stored under kv.key
+#define HT530_OP_PUT  1   ///< store kv.data under kv.key (0 is stored like any other value)
+#define HT530_OP_DEL  2   ///< remove kv.key, kv.data <- the value it had
+#define HT530_OP_CAS        3   ///< HT530_RMW only (needs an expected value), see below
+#define HT530_OP_FETCH_ADD  4   ///< add kv.data to the value under kv.key (absent counts as 0), kv.data <- the old value
+#define HT530_OP_INSERT     5   ///< store kv.data only if kv.key is absent (-EEXIST otherwise), kv.data <- the present value
+
+struct ht530_op {    // one item of a batch
+   __u32 op;         // HT530_OP_*
+   __s32 status;     // out: 0 = done, 1 = put/fetch-add found an existing value, -ENOENT = no such key,
+                     //      -EEXIST = insert found the key present, -EINVAL = bad op
+   struct ht kv;
+};
+
+struct ht530_batch {
+   __u64 ops;        // user pointer to an array of nr struct ht530_op, statuses are written back in place
+   __u32 nr;         // number of ops
+   __u32 done;       // out: ops processed (less than nr only when an error is returned)
+};
+
+#define HT530_BATCH _IOWR('d','b',struct ht530_batch)
+
+/*
+ * Atomic read-modify-write on one int key, done in a single locked step inside the module. The
+ * return value depends on op:
+ *   HT530_OP_CAS        0 = data stored, -EAGAIN = value wasn't expected, -ENOENT = no such key
+ *   HT530_OP_FETCH_ADD  1 = added to an existing value, 0 = key was absent and now holds data
+ *   HT530_OP_INSERT     0 = inserted, -EEXIST = key already present
+ *   HT530_OP_DEL        0 = removed (get-and-delete), -ENOENT = no such key
+ * old is the value the key had before the op (0 if absent) whatever the outcome. CAS and FETCH_ADD
+ * fail with -EINVAL on a key holding a non-int value.
+ */
+struct ht530_rmw {
+   __u32 op;         // HT530_OP_CAS, _FETCH_ADD, _INSERT or _DEL
+   __s32 key;
+   __s32 data;       // CAS: new value, FETCH_ADD: addend (wraps around), INSERT: value
+   __s32 expected;   // CAS: swap only if the current value is this
+   __s32 old;        // out
+   __u32 pad;
+};
+
+#define HT530_RMW _IOWR('d','a',struct ht530_rmw)
+
+
+/*
+ * Shared-memory rings. HT530_RING_SETUP creates a submission queue (SQ) and a completion queue (CQ)
+ * for the fd; mmap() the fd (offset 0, params.map_size bytes) to reach them. Userspace fills SQEs and
+ * advances sq_tail, the module consumes them (on HT530_RING_ENTER, or continuously from a polling
+ * kernel thread with HT530_RING_SQPOLL) and posts one CQE per SQE, advancing cq_tail. Heads and tails
+ * are free-running counters; index = counter & (entries - 1).
+ */
+#define HT530_RING_SQPOLL        (1U << 0)   ///< setup: serve the SQ from a kernel thread, no syscalls needed (CAP_SYS_ADMIN, -EAGAIN past sqpoll_max threads)
+#define HT530_RING_NEED_WAKEUP   (1U << 0)   ///< hdr.flags: the polling thread went idle, kick it with ENTER
+
+struct ht530_ring_hdr {    // start of the mapping; each index lives on its own cache line
+   __u32 sq_head;          // written by the module
+   __u32 pad0[15];
+   __u32 sq_tail;          // written by userspace
+   __u32 pad1[15];
+   __u32 cq_head;          // written by userspace
+   __u32 pad2[15];
+   __u32 cq_tail;          // written by the module
+   __u32 pad3[15];
+   __u32 flags;            // HT530_RING_NEED_WAKEUP
+   __u32 sq_entries;
+   __u32 cq_entries;
+   __u32 pad4[13];
+};
+
+struct ht530_sqe {
+   __u32 op;               // HT530_OP_*
+   __u32 rsvd;
+   struct ht kv;
+   __u64 user_data;        // copied to the matching CQE
+};
+
+struct ht530_cqe {
+   __u64 user_data;
+   __s32 status;           // as ht530_op.status
+   __s32 data;             // value for HT530_OP_GET / _DEL, old value for _FETCH_ADD / _INSERT
+};
+
+struct ht530_ring_params {
+   __u32 sq_entries;       // in: power of two, at most 32768
+   __u32 cq_entries;       // in: power of two >= sq_entries, 0 = 2 * sq_entries
+   __u32 flags;            // in: HT530_RING_SQPOLL
+   __u32 sq_idle_ms;       // in: SQPOLL thread spins this long without work before sleeping, at most 1000, 0 = 1000
+   __s32 sq_cpu;           // in: CPU to pin the SQPOLL thread to, -1 = any (ignored without SQPOLL)
+   __u32 sq_off;           // out: byte offset of the SQE array in the mapping
+   __u32 cq_off;           // out: byte offset of the CQE array in the mapping
+   __u32 map_size;         // out: length to mmap
+};
+
+#define HT530_ENTER_GETEVENTS    (1U << 0)   ///< wait until min_complete CQEs are ready
+#define HT530_ENTER_SQ_WAKEUP    (1U << 1)   ///< wake a sleeping SQPOLL thread
+
+struct ht530_ring_enter {
+   __u32 to_submit;        // without SQPOLL: consume up to this many SQEs
+   __u32 min_complete;
+   __u32 flags;            // HT530_ENTER_*
+   __u32 submitted;        // out: SQEs consumed by this call
+};
+
+/*
+ * Streaming export of the whole table. Start with cursor 0 and call again with the returned cursor
+ * until it comes back as HT530_EXPORT_END. Each call fills up to nr entries of buf. The walk is
+ * lock-free and weakly consistent: entries added or removed while it runs may or may not be seen,
+ * everything present for the whole walk is returned exactly once. If the table was resized between
+ * calls HT530_EXPORT_RESIZED is reported; nothing is skipped, but entries near the cursor may repeat.
+ * If it was rehashed under a new hash key (see chain_max) the walk starts over from the beginning and
+ * HT530_EXPORT_RESTARTED is reported: entries already returned come again.
+ */
+#define HT530_EXPORT_DRAIN      (1U << 0)   ///< in: remove what is exported (destructive, like DUMP but table-wide)
+#define HT530_EXPORT_RESIZED    (1U << 8)   ///< out: the table changed size since the cursor was issued
+#define HT530_EXPORT_RESTARTED  (1U << 9)   ///< out: the table was reseeded, the walk started over
+#define HT530_EXPORT_END        (~0ULL)
+
+struct ht530_export {
+   __u64 cursor;           // in/out
+   __u64 buf;              // user pointer to nr struct ht
+   __u32 nr;               // in: capacity of buf, out: entries written
+   __u32 flags;            // in/out: HT530_EXPORT_*
+};
+
+#define HT530_EXPORT _IOWR('d','x',struct ht530_export)
+
+#define HT530_RING_SETUP _IOWR('d','r',struct ht530_ring_params)
+#define HT530_RING_ENTER _IOWR('d','e',struct ht530_ring_enter)
+
+/*
+ * Table instances. Every minor of the device is its own table with its own locks, size and stats:
+ * table 0 is /dev/ht530, table n is /dev/ht530-n. The module creates ntables of them at load time,
+ * more can be added and removed at runtime through any open table (CAP_SYS_ADMIN). Table 0 can't be
+ * destroyed. A destroyed table stays usable through fds that already had it open.
+ *
+ * A table with a budget is a cache: an insert past max_entries or max_bytes evicts entries that
+ * haven't been looked up recently. Entries with a TTL read as absent once it has passed.
+ *
+ * A table created with HT530_TABLE_CACHE also gives entries back when the host runs short of memory:
+ * the kernel's reclaim evicts them the same way, and empties a cache table that has seen no operation
+ * for reclaim_idle_ms outright. The entries of every table are charged to the memory cgroup of
+ * whoever stored them.
+ */
+#define HT530_MAX_TABLES  256
+
+struct ht530_table_info {
+   __s32 id;               // in: wanted id, -1 = any free one; out: the table's id
+   __u32 init_bits;        // in/out: log2 of the initial and minimum bucket count, 0 = module default
+   __u32 max_bits;         // in/out: log2 of the largest bucket count, 0 = module default
+   __u32 ttl_ms;           // in/out: TTL of entries put without one, 0 = module default (default_ttl_ms)
+   __u64 max_entries;      // in/out: entry budget, 0 = module default; CLOCK-evicts beyond it
+   __u64 max_bytes;        // in/out: budget in bytes of entries, 0 = module default
+   __u32 flags;            // in/out: HT530_TABLE_*
+   __u32 pad;
+};
+
+#define HT530_TABLE_ORDERED  (1U << 0)   ///< also keep the keys in order, for HT530_RANGE / _NEXT / _PREV
+#define HT530_TABLE_CACHE    (1U << 1)   ///< entries may be dropped under memory pressure (chain backend only)
+
+#define HT530_TABLE_CREATE  _IOWR('d','c',struct ht530_table_info)
+#define HT530_TABLE_DESTROY _IOW('d','k',__s32)   ///< argument: pointer to the id
+
+/*
+ * Ordered scans, on tables created with HT530_TABLE_ORDERED (-EOPNOTSUPP on others). Keys are
+ * ordered with 4-byte keys first, compared as ints, then all other keys bytewise (a prefix before
+ * its extensions). Each call fills buf with records in scan order, struct ht530_rec followed by the
+ * key and the value, padded to a multiple of 8 bytes:
+ *   HT530_RANGE  ascending from key (inclusive) up to end (inclusive)
+ *   HT530_NEXT   ascending from just after key, i.e. key's successors; nr = 1 for the successor
+ *   HT530_PREV   descending from just before key down to end; nr = 1 for the predecessor
+ * An empty key (klen 0) starts at the first (PREV: last) key, an empty end doesn't bound the scan.
+ * Returns 0 if the scan reached its end, 1 if it stopped because nr or size ran out: continue with
+ * HT530_NEXT (or HT530_PREV) from the last record's key. -ENOSPC if not even one record fits. The scan
+ * is weakly consistent, like HT530_EXPORT.
+ */
+struct ht530_range {
+   __u64 key;              // user pointer to the start key
+   __u64 end;              // user pointer to the end key
+   __u32 klen;             // 0..HT530_KEY_MAX
+   __u32 elen;             // 0..HT530_KEY_MAX
+   __u64 buf;              // user pointer to size bytes for the records
+   __u32 size;             // in: bytes at buf, out: bytes written
+   __u32 nr;               // in: most records wanted, 0 = as many as fit; out: records written
+};
+
+struct ht530_rec {
+   __u32 klen;
+   __u32 vlen;
+};
+
+#define HT530_REC_SIZE(klen, vlen)  ((sizeof(struct ht530_rec) + (klen) + (vlen) + 7) & ~7UL)
+
+#define HT530_RANGE  _IOWR('d','o',struct ht530_range)
+#define HT530_NEXT   _IOWR('d','n',struct ht530_range)
+#define HT530_PREV   _IOWR('d','v',struct ht530_range)
+
+/*
+ * Snapshots for warm restarts. An image is a header, one record per entry laid out as for HT530_RANGE
+ * (struct ht530_rec, key, value, padding to 8 bytes) and a trailer holding the record count and a
+ * CRC32 (crc32_le, seed ~0) of every byte before it. TTLs aren't saved; restored entries get the
+ * table's default TTL.
+ *
+ * HT530_SNAP_SAVE streams the image out: start with a zeroed struct and call again, passing the
+ * returned cursor, crc and count back unchanged and appending each call's size bytes of buf to the
+ * file, until cursor comes back as HT530_SNAP_DONE. Like HT530_EXPORT the walk is weakly consistent;
+ * across a resize a few records near the cursor may repeat, across a reseed all of those before it,
+ * which a restore simply overwrites.
+ * buf must hold at least one record of the largest key and value (-ENOSPC otherwise).
+ *
+ * HT530_SNAP_LOAD takes a whole image (e.g. the mmap()ed file) in one call. Nothing is inserted until
+ * the image checks out: -EINVAL for a malformed image, -EBADMSG for a count or checksum mismatch
+ * (truncated or corrupted file), -EFBIG for more entries than the table can hold (max_load at its
+ * largest size, and its max_entries / max_bytes budget). The table is then grown once to fit and the entries inserted as
+ * puts, so keys already present are overwritten.
+ */
+#define HT530_SNAP_MAGIC    0x33353448   ///< "HT53"
+#define HT530_SNAP_TAIL     0x444e4548   ///< "HEND"
+#define HT530_SNAP_VERSION  1
+#define HT530_SNAP_DONE     (~0ULL)
+
+struct ht530_snap_hdr {
+   __u32 magic;            // HT530_SNAP_MAGIC
+   __u32 version;          // HT530_SNAP_VERSION
+   __u64 nelems;           // entries at save time, to presize the restore
+};
+
+struct ht530_snap_tail {
+   __u32 magic;            // HT530_SNAP_TAIL
+   __u32 crc;              // of everything from the header up to here
+   __u64 count;            // records in the image
+};
+
+struct ht530_snap {
+   __u64 cursor;           // in/out, 0 to start
+   __u64 buf;              // user pointer to size bytes
+   __u32 size;             // in: bytes at buf; out: bytes of image written there
+   __u32 crc;              // in/out: running checksum, 0 to start
+   __u64 count;            // in/out: records so far, 0 to start
+};
+
+struct ht530_snap_load {
+   __u64 buf;              // user pointer to the image
+   __u64 size;             // its length in bytes
+   __u64 count;            // out: entries restored
+};
+
+#define HT530_SNAP_SAVE  _IOWR('d','s',struct ht530_snap)
+#define HT530_SNAP_LOAD  _IOWR('d','l',struct ht530_snap_load)
+
+/*
+ * Bulk load, for warming a table: one call puts a whole packed array of struct ht pairs, from memory
+ * (buf, e.g. an mmap()ed file) or read by the module itself from an open file (fd, with buf 0).
+ * Pairs are stored as HT530_OP_PUT stores them (data 0 too) and get the table's default TTL; of two
+ * pairs with the same key the later one wins. The table is grown once to fit before anything goes in.
+ *
+ * count is the number of pairs at buf; reading from fd it is a limit, 0 = up to the end of the file.
+ * The file is read from offset on with pread semantics, so its own file position doesn't move; a
+ * partial pair at the end of the file is -EINVAL. After an error the first loaded pairs are in the
+ * table and the rest are not.
+ */
+struct ht530_bulk_load {
+   __u64 buf;              // user pointer to count struct ht, or 0 to read from fd
+   __u64 count;            // pairs at buf; with fd, the most to read (0 = to end of file)
+   __u64 offset;           // with fd: byte offset of the first pair in the file
+   __s32 fd;               // with buf 0: file to read the pairs from
+   __u32 pad;
+   __u64 loaded;           // out: pairs put
+};
+
+#define HT530_BULK_LOAD  _IOWR('d','i',struct ht530_bulk_load)
+
+/*
+ * Change log, for followers that mirror a table. HT530_WATCH makes the fd a watcher: from then on
+ * every change to its table is appended to a ring private to the fd, and read() on it returns those
+ * records instead of doing a lookup. A record is a struct ht530_change followed by the key and the
+ * value (none for deletes), padded to a multiple of 8 bytes. Evictions, expiries and DUMP drains
+ * arrive as deletes; an expired entry is reported when it is actually dropped, which can be a while
+ * after it stopped being visible.
+ *
+ * read() blocks until a record is there (-EAGAIN with O_NONBLOCK) and returns whole records only,
+ * -EINVAL if len can't hold the next one; poll()/epoll report EPOLLIN while records are waiting.
+ * seq numbers the table's changes in the order they were applied (counting only while the table has
+ * watchers). A watcher that doesn't keep up loses records rather than slow the writers down: the next
+ * record it gets is HT530_CHANGE_OVERFLOW, with seq set to the first change lost, after which it
+ * should resync (e.g. with HT530_EXPORT) and apply the changes that follow.
+ *
+ * keys optionally limits the watcher to nkeys keys, given as records laid out as for HT530_RANGE
+ * with vlen 0 (struct ht530_rec, key, padding to 8 bytes).
+ */
+#define HT530_WATCH_KEYS_MAX  256
+
+struct ht530_watch {
+   __u32 size;             // ring bytes, 0 = 256 KiB; rounded up to a power of 2 between 128 KiB and 64 MiB
+   __u32 nkeys;            // 0 = every key, at most HT530_WATCH_KEYS_MAX
+   __u64 keys;             // user pointer to the key records
+};
+
+#define HT530_CHANGE_INSERT    1
+#define HT530_CHANGE_REPLACE   2
+#define HT530_CHANGE_DELETE    3
+#define HT530_CHANGE_OVERFLOW  4   ///< changes from seq on were dropped
+
+struct ht530_change {
+   __u64 seq;
+   __u32 op;               // HT530_CHANGE_*
+   __u32 klen;
+   __u32 vlen;
+   __u32 pad;
+};
+
+#define HT530_CHANGE_SIZE(klen, vlen)  ((sizeof(struct ht530_change) + (klen) + (vlen) + 7) & ~7UL)
+
+#define HT530_WATCH  _IOW('d','w',struct ht530_watch)
+
+/*
+ * Read-only view, for lookups without a system call. A table created while the view_bits module
+ * parameter is set keeps a copy of its int pairs in a flat array of cache-line-sized lines that any
+ * fd on it can mmap() read-only at offset HT530_VIEW_OFFSET (map HT530_VIEW_HDR_SIZE bytes first to
+ * learn hdr.map_size, or map_size straight away if known). A key lives in one line, picked by a
+ * multiplicative hash under the table's view seed; writers keep the line in step with the table
+ * while holding the key's bucket lock, bumping its seq to odd before the change and to even after,
+ * so a lookup that saw the same even seq before and after reading the line read a consistent one.
+ *
+ * Only int pairs go in the view. A key whose line is full, whose value isn't 4 bytes or whose entry
+ * has a TTL (the view can't expire it) is counted in its line's ovf instead, and a lookup that doesn't
+ * find its key in a line with ovf set has to ask the module with read(). ht530_view_get() below
+ * does the whole lookup. Lookups through the view don't set the CLOCK reference bit and aren't in
+ * the stats.
+ */
+#define HT530_VIEW_OFFSET    0x40000000UL   ///< mmap offset of the view
+#define HT530_VIEW_HDR_SIZE  4096           ///< bytes of the mapping taken by struct ht530_view_hdr
+#define HT530_VIEW_MAGIC     0x68743576     ///< "ht5v", layout version 1
+#define HT530_VIEW_SLOTS     7              ///< pairs per line
+
+struct ht530_view_hdr {    // start of the mapping
+   __u32 magic;            // HT530_VIEW_MAGIC
+   __u32 nbits;            // 2^nbits lines
+   __u64 map_size;         // bytes to mmap for the whole view
+   __u64 lines_off;        // byte offset of the first struct ht530_view_line
+   __u64 seed, mul;        // a key's line is (((__u32)key ^ seed) * mul) >> (64 - nbits)
+};
+
+struct ht530_view_line {
+   __u32 seq;              // odd while the module is changing the line
+   __u8 used;              // bit i: slot[i] holds a pair
+   __u8 ovf;               // keys of this line that aren't in it; 255 stays put
+   __u16 pad;
+   __u64 slot[HT530_VIEW_SLOTS];   // key in the low 32 bits, value in the high 32 bits
+};
+
+#ifndef __KERNEL__
+static inline const struct ht530_view_line *ht530_view_line_of(const struct ht530_view_hdr *v, int key){
+   return (const struct ht530_view_line *)((const char *)v + v->lines_off) +
+          ((((__u64)(__u32)key ^ v->seed) * v->mul) >> (64 - v->nbits));
+}
+
+/// Look key up in a mapped view: 1 with *data set, 0 if the table doesn't have it, -1 to ask read().
+static inline int ht530_view_get(const struct ht530_view_hdr *v, int key, int *data){
+   const struct ht530_view_line *l = ht530_view_line_of(v, key);
+   unsigned int tries, i, used, seq;
+   __u64 kv;
+   int ret, val = 0;
+
+   for (tries = 0; tries < 64; tries++) {   // a writer holds a line for a few dozen ns at most
+      seq = __atomic_load_n(&l->seq, __ATOMIC_ACQUIRE);
+      if (seq & 1)
+         continue;
+      used = __atomic_load_n(&l->used, __ATOMIC_RELAXED);
+      ret = __atomic_load_n(&l->ovf, __ATOMIC_RELAXED) ? -1 : 0;
+      for (i = 0; i < HT530_VIEW_SLOTS; i++) {
+         kv = __atomic_load_n(&l->slot[i], __ATOMIC_RELAXED);
+         if ((used & (1U << i)) && (__u32)kv == (__u32)key) {
+            val = (int)(kv >> 32);
+            ret = 1;
+            break;
+         }
+      }
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);   // the line was read before seq is checked again
+      if (__atomic_load_n(&l->seq, __ATOMIC_RELAXED) == seq) {
+         if (ret > 0)
+            *data = val;
+         return ret;
+      }
+   }
+   return -1;
+}
+#endif
+
+#endif
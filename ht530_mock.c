@@ -0,0 +1,223 @@
+/**
+ * @file   ht530_mock.c
+ * @brief   In-process stand-in for /dev/ht530 (see ht530_mock.h)
+ *
+ * Plays the part of ht530_dev.c for the userspace build: a descriptor is a slot holding its table,
+ * and read/write/ioctl go to the same core entry points dev_read/dev_write/dev_ioctl call.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "ht530_core.h"
+#include "ht530_mock.h"
+
+#define mock_fd_base  (1 << 20)   /// far above the descriptors the process opens for real
+#define mock_max_fds  4096
+
+static pthread_once_t mock_once = PTHREAD_ONCE_INIT;
+static int mock_err;                                        /// why the tables couldn't be set up
+static struct ht530_table *mock_tables[HT530_MAX_TABLES];
+static unsigned int mock_ntables = 1;                       /// ntables=, as the module parameter
+static bool mock_ordered;                                   /// ordered=
+static bool mock_cache;                                     /// cache=
+static pthread_mutex_t mock_lock = PTHREAD_MUTEX_INITIALIZER;   /// guards the slots
+static struct ht530_table *mock_fds[mock_max_fds];          /// table of each open descriptor
+static unsigned int mock_nopen;
+
+static void mock_exit(void){   /// free everything, unless the program left descriptors open
+   unsigned int i;
+
+   if (mock_nopen)
+      return;   // threads may still be using them
+   for (i = 0; i < mock_ntables; i++)
+      ht530_table_free(mock_tables[i]);
+   ht530_core_exit();
+}
+
+static int mock_params(void){   /// HT530_PARAMS, "name=value ..." as insmod takes them
+   char *params, *tok, *save, *val;
+   const struct kernel_param ordered_param = { .arg = &mock_ordered };
+   const struct kernel_param cache_param = { .arg = &mock_cache };
+   int ret = 0;
+
+   if (!getenv("HT530_PARAMS"))
+      return 0;
+   params = strdup(getenv("HT530_PARAMS"));
+   if (!params)
+      return -ENOMEM;
+   for (tok = strtok_r(params, " \t,", &save); tok && !ret; tok = strtok_r(NULL, " \t,", &save)) {
+      val = strchr(tok, '=');
+      if (val)
+         *val++ = 0;
+      if (!strcmp(tok, "ntables")) {
+         mock_ntables = val ? strtoul(val, NULL, 0) : 0;
+         ret = val ? 0 : -EINVAL;
+      } else if (!strcmp(tok, "ordered")) {
+         ret = param_set_bool(val, &ordered_param);
+      } else if (!strcmp(tok, "cache")) {
+         ret = param_set_bool(val, &cache_param);
+      } else {
+         ret = shim_param_set(tok, val ? val : "");
+      }
+      if (ret)
+         printk(KERN_ALERT "ht530: bad parameter %s\n", tok);
+   }
+   free(params);
+   return ret;
+}
+
+static void mock_init(void){   /// ht530_init, without the device nodes
+   struct ht530_table_info info = { 0 };
+   unsigned int i;
+
+   shim_verbose = getenv("HT530_VERBOSE");
+   mock_err = mock_params();
+   if (mock_err)
+      return;
+   mock_ntables = clamp_t(unsigned int, mock_ntables, 1, HT530_MAX_TABLES);
+   info.flags = (mock_ordered ? HT530_TABLE_ORDERED : 0) | (mock_cache ? HT530_TABLE_CACHE : 0);
+   mock_err = ht530_core_init();
+   if (mock_err)
+      return;
+   for (i = 0; i < mock_ntables; i++) {
+      mock_tables[i] = ht530_table_new(&info);
+      if (IS_ERR(mock_tables[i])) {
+         mock_err = PTR_ERR(mock_tables[i]);
+         while (i--)
+            ht530_table_free(mock_tables[i]);
+         ht530_core_exit();
+         return;
+      }
+      mock_tables[i]->id = i;
+   }
+   atexit(mock_exit);
+}
+
+static struct ht530_table *mock_table(int fd){   /// table behind a mock descriptor, NULL for a real one
+   if (fd < mock_fd_base || fd >= mock_fd_base + mock_max_fds)
+      return NULL;
+   return mock_fds[fd - mock_fd_base];
+}
+
+static long mock_ret(long ret){   /// a driver return value as the system call would give it
+   if (ret < 0) {
+      errno = -ret;
+      return -1;
+   }
+   return ret;
+}
+
+int ht530_mock_open(const char *path, int flags, ...){
+   unsigned int id = 0, i;
+   int fd = -ENFILE;
+   mode_t mode = 0;
+   va_list ap;
+   char end;
+
+   if (strcmp(path, "/dev/ht530") && sscanf(path, "/dev/ht530-%u%c", &id, &end) != 1) {
+      if (flags & (O_CREAT | O_TMPFILE)) {
+         va_start(ap, flags);
+         mode = va_arg(ap, mode_t);
+         va_end(ap);
+      }
+      return open(path, flags, mode);
+   }
+   pthread_once(&mock_once, mock_init);
+   if (mock_err)
+      return mock_ret(mock_err);
+   if (id >= mock_ntables)
+      return mock_ret(-ENOENT);   // no such node
+   pthread_mutex_lock(&mock_lock);
+   for (i = 0; i < mock_max_fds; i++) {
+      if (!mock_fds[i]) {
+         mock_fds[i] = mock_tables[id];
+         mock_nopen++;
+         fd = mock_fd_base + i;
+         break;
+      }
+   }
+   pthread_mutex_unlock(&mock_lock);
+   return mock_ret(fd);
+}
+
+int ht530_mock_close(int fd){
+   if (!mock_table(fd))
+      return close(fd);
+   pthread_mutex_lock(&mock_lock);
+   mock_fds[fd - mock_fd_base] = NULL;
+   mock_nopen--;
+   pthread_mutex_unlock(&mock_lock);
+   return 0;
+}
+
+ssize_t ht530_mock_read(int fd, void *buf, size_t len){
+   struct ht530_table *t = mock_table(fd);
+
+   if (!t)
+      return read(fd, buf, len);
+   return mock_ret(ht530_table_read(t, buf));
+}
+
+ssize_t ht530_mock_write(int fd, const void *buf, size_t len){
+   struct ht530_table *t = mock_table(fd);
+
+   if (!t)
+      return write(fd, buf, len);
+   return mock_ret(ht530_table_write(t, buf, len));
+}
+
+int ht530_mock_ioctl(int fd, unsigned long request, ...){
+   struct ht530_table *t = mock_table(fd);
+   unsigned long arg;
+   va_list ap;
+
+   va_start(ap, request);
+   arg = va_arg(ap, unsigned long);
+   va_end(ap);
+   if (!t)
+      return ioctl(fd, request, arg);
+   switch (request) {
+   case HT530_RING_SETUP:
+   case HT530_RING_ENTER:
+   case HT530_WATCH:
+   case HT530_TABLE_CREATE:
+   case HT530_TABLE_DESTROY:
+      return mock_ret(-ENOTTY);   // the device file's own ioctls
+   default:
+      return mock_ret(ht530_table_ioctl(t, request, arg));
+   }
+}
+
+void *ht530_mock_mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off){   /// the view only, handed out in place
+   struct ht530_table *t = mock_table(fd);
+   int err = ENODEV;   // no rings
+
+   if (!t)
+      return mmap(addr, len, prot, flags, fd, off);
+   if (off == HT530_VIEW_OFFSET)
+      err = !t->view ? ENXIO : prot & PROT_WRITE ? EACCES : len > t->view_size ? EINVAL : 0;
+   if (err) {
+      errno = err;
+      return MAP_FAILED;
+   }
+   return t->view;
+}
+
+int ht530_mock_munmap(void *addr, size_t len){
+   unsigned int i;
+
+   for (i = 0; i < mock_ntables; i++)
+      if (mock_tables[i] && addr == mock_tables[i]->view)
+         return 0;   // the table's own memory, freed with it
+   return munmap(addr, len);
+}
+
+unsigned long ht530_mock_reclaim(unsigned long nr){
+   return shim_reclaim(nr);
+}
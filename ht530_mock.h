@@ -0,0 +1,43 @@
+/**
+ * @file   ht530_mock.h
+ * @brief   In-process stand-in for /dev/ht530, over the userspace build of the table core
+ *
+ * ht530_mock_open() of /dev/ht530 or /dev/ht530-<n> returns a descriptor that the other calls serve
+ * from tables in this process, with the device's read()/write()/ioctl() semantics; any other path
+ * or descriptor goes to the real system call. Built with -DHT530_MOCK, a program that includes this
+ * header after its system headers has its open/close/read/write/ioctl/mmap calls routed here, so the
+ * same test and benchmark sources run against the core under perf, gdb or the sanitizers (make user).
+ *
+ * The tables are created on the first open, configured from HT530_PARAMS in the environment with the
+ * module's parameters, e.g. HT530_PARAMS="ntables=2 backend=open max_load=200". Set HT530_VERBOSE
+ * to see the module's KERN_INFO/KERN_DEBUG messages. The mock maps only the read-only view (handing
+ * out the table's own copy, so it is writable in fact), not the rings; it has no poll, so no
+ * HT530_WATCH, and the table list is fixed: those ioctls fail with ENOTTY. There is no memory pressure
+ * either: ht530_mock_reclaim() runs the shrinkers of cache tables (cache=1) by hand.
+ */
+
+#ifndef HT530_MOCK_H
+#define HT530_MOCK_H
+
+#include <sys/types.h>
+
+int ht530_mock_open(const char *path, int flags, ...);
+int ht530_mock_close(int fd);
+ssize_t ht530_mock_read(int fd, void *buf, size_t len);
+ssize_t ht530_mock_write(int fd, const void *buf, size_t len);
+int ht530_mock_ioctl(int fd, unsigned long request, ...);
+void *ht530_mock_mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off);
+int ht530_mock_munmap(void *addr, size_t len);
+unsigned long ht530_mock_reclaim(unsigned long nr);   /// memory pressure asking for nr objects, returns those freed
+
+#ifdef HT530_MOCK
+#define open(...)   ht530_mock_open(__VA_ARGS__)
+#define close(...)  ht530_mock_close(__VA_ARGS__)
+#define read(...)   ht530_mock_read(__VA_ARGS__)
+#define write(...)  ht530_mock_write(__VA_ARGS__)
+#define ioctl(...)  ht530_mock_ioctl(__VA_ARGS__)
+#define mmap(...)   ht530_mock_mmap(__VA_ARGS__)
+#define munmap(...) ht530_mock_munmap(__VA_ARGS__)
+#endif
+
+#endif
@@ -0,0 +1,924 @@
+/**
+ * @file   ht530_shim.c
+ * @brief   Userspace implementations behind ht530_shim.h
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdarg.h>
+#include <sched.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+
+#include "ht530_shim.h"
+
+bool shim_verbose;   /// print KERN_INFO and KERN_DEBUG messages too
+
+int printk(const char *fmt, ...){
+   va_list ap;
+   int level = 4, n;
+
+   if (fmt[0] == KERN_SOH[0] && fmt[1]) {
+      level = fmt[1] - '0';
+      fmt += 2;
+   }
+   if (level > 4 && !shim_verbose)
+      return 0;
+   va_start(ap, fmt);
+   n = vfprintf(stderr, fmt, ap);
+   va_end(ap);
+   return n;
+}
+
+
+/*
+ * Allocation
+ */
+void *shim_alloc(size_t size, gfp_t gfp){
+   void *p = aligned_alloc(64, ALIGN(size ? size : 1, 64));
+
+   if (p && (gfp & __GFP_ZERO))
+      memset(p, 0, size);
+   return p;
+}
+
+void shim_free(const void *p){
+   free((void *)p);
+}
+
+struct kmem_cache *kmem_cache_create(const char *name, unsigned int size, unsigned int align,
+                                     unsigned long flags, void (*ctor)(void *)){
+   struct kmem_cache *s = shim_alloc(sizeof(*s), GFP_KERNEL);
+
+   if (s) {
+      s->size = size;
+      s->align = align;
+   }
+   return s;
+}
+
+void kmem_cache_destroy(struct kmem_cache *s){
+   shim_free(s);
+}
+
+void *kmem_cache_alloc(struct kmem_cache *s, gfp_t gfp){
+   return shim_alloc(s->size, gfp);
+}
+
+void kmem_cache_free(struct kmem_cache *s, void *p){
+   shim_free(p);
+}
+
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t gfp, size_t nr, void **p){   /// all or nothing, as in the kernel
+   size_t i;
+
+   for (i = 0; i < nr; i++) {
+      p[i] = kmem_cache_alloc(s, gfp);
+      if (!p[i]) {
+         kmem_cache_free_bulk(s, i, p);
+         return 0;
+      }
+   }
+   return nr;
+}
+
+void kmem_cache_free_bulk(struct kmem_cache *s, size_t nr, void **p){
+   while (nr)
+      kmem_cache_free(s, p[--nr]);
+}
+
+/* Shrinkers run only when asked to, through shim_reclaim(), in batches as shrink_slab() would */
+#define shim_shrink_batch  128
+static struct shrinker *shim_shrinkers;
+static pthread_mutex_t shim_shrinker_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int register_shrinker(struct shrinker *s){
+   pthread_mutex_lock(&shim_shrinker_lock);
+   s->next = shim_shrinkers;
+   shim_shrinkers = s;
+   pthread_mutex_unlock(&shim_shrinker_lock);
+   return 0;
+}
+
+void unregister_shrinker(struct shrinker *s){
+   struct shrinker **p;
+
+   pthread_mutex_lock(&shim_shrinker_lock);
+   for (p = &shim_shrinkers; *p; p = &(*p)->next) {
+      if (*p == s) {
+         *p = s->next;
+         break;
+      }
+   }
+   pthread_mutex_unlock(&shim_shrinker_lock);
+}
+
+unsigned long shim_reclaim(unsigned long nr){
+   struct shrink_control sc = { .gfp_mask = GFP_KERNEL };
+   struct shrinker *s;
+   unsigned long left, got, freed = 0;
+
+   pthread_mutex_lock(&shim_shrinker_lock);
+   for (s = shim_shrinkers; s; s = s->next) {
+      left = s->count_objects(s, &sc);
+      if (left == SHRINK_EMPTY)
+         continue;
+      for (left = min(left, nr); left; left -= sc.nr_to_scan) {
+         sc.nr_to_scan = min_t(unsigned long, left, shim_shrink_batch);
+         got = s->scan_objects(s, &sc);
+         if (got == SHRINK_STOP)
+            break;
+         freed += got;
+      }
+   }
+   pthread_mutex_unlock(&shim_shrinker_lock);
+   return freed;
+}
+
+
+/*
+ * Per-CPU data. Threads are dealt slots round robin on first use; a thread keeps its slot, several
+ * threads may share one, so this_cpu_inc is atomic and local_bh_disable() takes the slot's lock.
+ */
+__thread int shim_cpu = -1;
+static int shim_next_cpu;
+static pthread_mutex_t shim_bh_lock[SHIM_NR_CPUS] = { [0 ... SHIM_NR_CPUS - 1] = PTHREAD_MUTEX_INITIALIZER };
+static __thread int shim_bh_depth;
+
+int shim_cpu_slow(void){
+   shim_cpu = __atomic_fetch_add(&shim_next_cpu, 1, __ATOMIC_RELAXED) % SHIM_NR_CPUS;
+   return shim_cpu;
+}
+
+void *shim_alloc_percpu(size_t size){
+   if (size > SHIM_PCPU_STRIDE)
+      return NULL;
+   return shim_alloc((size_t)SHIM_NR_CPUS * SHIM_PCPU_STRIDE, __GFP_ZERO);
+}
+
+void local_bh_disable(void){
+   rcu_read_lock();
+   if (shim_bh_depth++ == 0)
+      pthread_mutex_lock(&shim_bh_lock[shim_this_cpu()]);
+}
+
+void local_bh_enable(void){
+   if (--shim_bh_depth == 0)
+      pthread_mutex_unlock(&shim_bh_lock[shim_this_cpu()]);
+   rcu_read_unlock();
+}
+
+
+/*
+ * Locks, wait queues, time
+ */
+int percpu_init_rwsem(struct percpu_rw_semaphore *sem){
+   pthread_rwlockattr_t attr;
+   int ret;
+
+   pthread_rwlockattr_init(&attr);
+   pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+   ret = pthread_rwlock_init(&sem->rw, &attr);
+   pthread_rwlockattr_destroy(&attr);
+   return -ret;
+}
+
+void init_waitqueue_head(wait_queue_head_t *wq){
+   pthread_mutex_init(&wq->lock, NULL);
+   pthread_cond_init(&wq->cond, NULL);
+}
+
+void wake_up_interruptible(wait_queue_head_t *wq){
+   pthread_mutex_lock(&wq->lock);
+   pthread_cond_broadcast(&wq->cond);
+   pthread_mutex_unlock(&wq->lock);
+}
+
+unsigned long shim_jiffies(void){
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (unsigned long)ts.tv_sec * HZ + ts.tv_nsec / (1000000000 / HZ);
+}
+
+u64 ktime_get_ns(void){
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/*
+ * RCU. Each thread that ever reads registers a record holding the grace-period counter it saw when
+ * its outermost rcu_read_lock() started, or 0 outside a read-side section. synchronize_rcu() bumps
+ * the counter and waits until no record holds an older value. The full barrier between a reader
+ * publishing its record and its first rcu_dereference(), and the one between the updater unpublishing
+ * a pointer and scanning the records, make sure that either the updater sees the reader or the
+ * reader doesn't see the pointer. The counter is 64 bits wide, so it never wraps.
+ */
+struct shim_rcu_reader {
+   unsigned long ctr;                // grace period the current read-side section started in, 0 = none
+   int nest;
+   struct shim_rcu_reader *next, **pprev;
+};
+
+static pthread_mutex_t shim_rcu_lock = PTHREAD_MUTEX_INITIALIZER;   // registry and grace periods
+static struct shim_rcu_reader *shim_rcu_readers;
+static unsigned long shim_rcu_gp = 1;
+static __thread struct shim_rcu_reader *shim_rcu_self;
+static pthread_key_t shim_rcu_key;
+static pthread_once_t shim_rcu_once = PTHREAD_ONCE_INIT;
+
+static void shim_rcu_unregister(void *arg){   /// thread exit
+   struct shim_rcu_reader *r = arg;
+
+   pthread_mutex_lock(&shim_rcu_lock);
+   *r->pprev = r->next;
+   if (r->next)
+      r->next->pprev = r->pprev;
+   pthread_mutex_unlock(&shim_rcu_lock);
+   free(r);
+}
+
+static void shim_rcu_init(void){
+   pthread_key_create(&shim_rcu_key, shim_rcu_unregister);
+}
+
+static struct shim_rcu_reader *shim_rcu_reader(void){
+   struct shim_rcu_reader *r = shim_rcu_self;
+
+   if (r)
+      return r;
+   pthread_once(&shim_rcu_once, shim_rcu_init);
+   r = calloc(1, sizeof(*r));
+   if (!r)
+      abort();
+   pthread_mutex_lock(&shim_rcu_lock);
+   r->next = shim_rcu_readers;
+   if (r->next)
+      r->next->pprev = &r->next;
+   r->pprev = &shim_rcu_readers;
+   shim_rcu_readers = r;
+   pthread_mutex_unlock(&shim_rcu_lock);
+   pthread_setspecific(shim_rcu_key, r);
+   shim_rcu_self = r;
+   return r;
+}
+
+void rcu_read_lock(void){
+   struct shim_rcu_reader *r = shim_rcu_reader();
+
+   if (r->nest++ == 0) {
+      __atomic_store_n(&r->ctr, __atomic_load_n(&shim_rcu_gp, __ATOMIC_RELAXED), __ATOMIC_SEQ_CST);
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   }
+}
+
+void rcu_read_unlock(void){
+   struct shim_rcu_reader *r = shim_rcu_self;
+
+   if (--r->nest == 0)
+      __atomic_store_n(&r->ctr, 0, __ATOMIC_RELEASE);
+}
+
+void synchronize_rcu(void){
+   struct shim_rcu_reader *r;
+   unsigned long gp, ctr;
+
+   pthread_mutex_lock(&shim_rcu_lock);
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   gp = shim_rcu_gp + 1;
+   __atomic_store_n(&shim_rcu_gp, gp, __ATOMIC_SEQ_CST);
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   for (r = shim_rcu_readers; r; r = r->next) {
+      while ((ctr = __atomic_load_n(&r->ctr, __ATOMIC_ACQUIRE)) && ctr < gp)
+         sched_yield();
+   }
+   pthread_mutex_unlock(&shim_rcu_lock);
+}
+
+/*
+ * call_rcu() queues for the reclaimer thread, which takes the whole queue, waits one grace period
+ * and runs the callbacks with BHs "disabled", as softirq would.
+ */
+static pthread_mutex_t shim_cb_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t shim_cb_cond = PTHREAD_COND_INITIALIZER;
+static struct rcu_head *shim_cb_head, **shim_cb_tail = &shim_cb_head;
+static unsigned long shim_cb_queued, shim_cb_done;
+static pthread_once_t shim_cb_once = PTHREAD_ONCE_INIT;
+
+static void *shim_rcu_reclaimer(void *arg){
+   struct rcu_head *list, *next;
+   unsigned long n;
+
+   pthread_mutex_lock(&shim_cb_lock);
+   for (;;) {
+      while (!shim_cb_head)
+         pthread_cond_wait(&shim_cb_cond, &shim_cb_lock);
+      list = shim_cb_head;
+      n = shim_cb_queued - shim_cb_done;
+      shim_cb_head = NULL;
+      shim_cb_tail = &shim_cb_head;
+      pthread_mutex_unlock(&shim_cb_lock);
+
+      synchronize_rcu();
+      local_bh_disable();
+      for (; list; list = next) {
+         next = list->next;
+         list->func(list);
+      }
+      local_bh_enable();
+
+      pthread_mutex_lock(&shim_cb_lock);
+      shim_cb_done += n;
+      pthread_cond_broadcast(&shim_cb_cond);
+   }
+   return NULL;
+}
+
+static void shim_cb_start(void){
+   pthread_t th;
+
+   if (pthread_create(&th, NULL, shim_rcu_reclaimer, NULL))
+      abort();
+   pthread_detach(th);
+}
+
+void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *head)){
+   pthread_once(&shim_cb_once, shim_cb_start);
+   head->func = func;
+   head->next = NULL;
+   pthread_mutex_lock(&shim_cb_lock);
+   *shim_cb_tail = head;
+   shim_cb_tail = &head->next;
+   shim_cb_queued++;
+   pthread_cond_broadcast(&shim_cb_cond);
+   pthread_mutex_unlock(&shim_cb_lock);
+}
+
+void rcu_barrier(void){   /// every callback queued so far has run
+   unsigned long target;
+
+   pthread_mutex_lock(&shim_cb_lock);
+   target = shim_cb_queued;
+   while ((long)(shim_cb_done - target) < 0)
+      pthread_cond_wait(&shim_cb_cond, &shim_cb_lock);
+   pthread_mutex_unlock(&shim_cb_lock);
+}
+
+
+/*
+ * Work items. One worker thread runs whatever is due, earliest first. A work item is on the queue
+ * at most once (pending); cancel_work_sync() takes it off and waits out a run in progress, including
+ * one that queued the item again. flush_work() waits for the item to be neither queued nor running.
+ */
+static pthread_mutex_t shim_wq_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t shim_wq_cond;
+static struct work_struct *shim_wq_head;
+static struct work_struct *shim_wq_running;
+static pthread_once_t shim_wq_once = PTHREAD_ONCE_INIT;
+
+static void shim_wq_unlink(struct work_struct *work){   /// under shim_wq_lock, work is pending
+   struct work_struct **p = &shim_wq_head;
+
+   while (*p != work)
+      p = &(*p)->next;
+   *p = work->next;
+   work->pending = false;
+}
+
+static void *shim_worker(void *arg){
+   struct work_struct *w, *due;
+   struct timespec ts;
+   unsigned long now;
+
+   pthread_mutex_lock(&shim_wq_lock);
+   for (;;) {
+      due = NULL;
+      for (w = shim_wq_head; w; w = w->next) {
+         if (!due || time_before(w->when, due->when))
+            due = w;
+      }
+      now = jiffies;
+      if (!due) {
+         pthread_cond_wait(&shim_wq_cond, &shim_wq_lock);
+      } else if (time_after(due->when, now)) {
+         clock_gettime(CLOCK_MONOTONIC, &ts);
+         ts.tv_sec += (due->when - now) / HZ;
+         ts.tv_nsec += (due->when - now) % HZ * (1000000000 / HZ);
+         if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+         }
+         pthread_cond_timedwait(&shim_wq_cond, &shim_wq_lock, &ts);
+      } else {
+         shim_wq_unlink(due);
+         shim_wq_running = due;
+         pthread_mutex_unlock(&shim_wq_lock);
+         due->func(due);
+         pthread_mutex_lock(&shim_wq_lock);
+         shim_wq_running = NULL;
+         pthread_cond_broadcast(&shim_wq_cond);
+      }
+   }
+   return NULL;
+}
+
+static void shim_wq_start(void){
+   pthread_condattr_t attr;
+   pthread_t th;
+
+   pthread_condattr_init(&attr);
+   pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+   pthread_cond_init(&shim_wq_cond, &attr);
+   pthread_condattr_destroy(&attr);
+   if (pthread_create(&th, NULL, shim_worker, NULL))
+      abort();
+   pthread_detach(th);
+}
+
+bool shim_queue_work(struct work_struct *work, unsigned long delay){
+   bool queued = false;
+
+   pthread_once(&shim_wq_once, shim_wq_start);
+   pthread_mutex_lock(&shim_wq_lock);
+   if (!work->pending) {
+      work->pending = true;
+      work->when = jiffies + delay;
+      work->next = shim_wq_head;
+      shim_wq_head = work;
+      pthread_cond_broadcast(&shim_wq_cond);
+      queued = true;
+   }
+   pthread_mutex_unlock(&shim_wq_lock);
+   return queued;
+}
+
+bool shim_cancel_work_sync(struct work_struct *work){
+   bool was_pending = false;
+
+   pthread_once(&shim_wq_once, shim_wq_start);
+   pthread_mutex_lock(&shim_wq_lock);
+   do {
+      if (work->pending) {
+         shim_wq_unlink(work);
+         was_pending = true;
+      }
+      while (shim_wq_running == work)
+         pthread_cond_wait(&shim_wq_cond, &shim_wq_lock);
+   } while (work->pending);   // the run we waited for queued it again
+   pthread_mutex_unlock(&shim_wq_lock);
+   return was_pending;
+}
+
+bool shim_flush_work(struct work_struct *work){
+   bool waited = false;
+
+   pthread_once(&shim_wq_once, shim_wq_start);
+   pthread_mutex_lock(&shim_wq_lock);
+   while (work->pending || shim_wq_running == work) {
+      pthread_cond_wait(&shim_wq_cond, &shim_wq_lock);
+      waited = true;
+   }
+   pthread_mutex_unlock(&shim_wq_lock);
+   return waited;
+}
+
+
+/*
+ * Red-black tree, as in CLRS with NULL leaves
+ */
+#define rb_is_red(n)  ((n) && (n)->rb_red)
+
+static void rb_set_child(struct rb_node *parent, struct rb_node *old, struct rb_node *n, struct rb_root *root){
+   if (!parent)
+      root->rb_node = n;
+   else if (parent->rb_left == old)
+      parent->rb_left = n;
+   else
+      parent->rb_right = n;
+}
+
+static void rb_rotate_left(struct rb_node *x, struct rb_root *root){
+   struct rb_node *y = x->rb_right;
+
+   x->rb_right = y->rb_left;
+   if (y->rb_left)
+      y->rb_left->rb_parent = x;
+   y->rb_parent = x->rb_parent;
+   rb_set_child(x->rb_parent, x, y, root);
+   y->rb_left = x;
+   x->rb_parent = y;
+}
+
+static void rb_rotate_right(struct rb_node *x, struct rb_root *root){
+   struct rb_node *y = x->rb_left;
+
+   x->rb_left = y->rb_right;
+   if (y->rb_right)
+      y->rb_right->rb_parent = x;
+   y->rb_parent = x->rb_parent;
+   rb_set_child(x->rb_parent, x, y, root);
+   y->rb_right = x;
+   x->rb_parent = y;
+}
+
+void rb_insert_color(struct rb_node *node, struct rb_root *root){
+   struct rb_node *parent, *gparent, *uncle;
+
+   while ((parent = node->rb_parent) && parent->rb_red) {
+      gparent = parent->rb_parent;   // a red node is never the root
+      if (parent == gparent->rb_left) {
+         uncle = gparent->rb_right;
+         if (rb_is_red(uncle)) {
+            uncle->rb_red = parent->rb_red = 0;
+            gparent->rb_red = 1;
+            node = gparent;
+            continue;
+         }
+         if (node == parent->rb_right) {
+            rb_rotate_left(parent, root);
+            node = parent;
+            parent = node->rb_parent;
+         }
+         parent->rb_red = 0;
+         gparent->rb_red = 1;
+         rb_rotate_right(gparent, root);
+      } else {
+         uncle = gparent->rb_left;
+         if (rb_is_red(uncle)) {
+            uncle->rb_red = parent->rb_red = 0;
+            gparent->rb_red = 1;
+            node = gparent;
+            continue;
+         }
+         if (node == parent->rb_left) {
+            rb_rotate_right(parent, root);
+            node = parent;
+            parent = node->rb_parent;
+         }
+         parent->rb_red = 0;
+         gparent->rb_red = 1;
+         rb_rotate_left(gparent, root);
+      }
+   }
+   root->rb_node->rb_red = 0;
+}
+
+static void rb_erase_fixup(struct rb_node *x, struct rb_node *parent, struct rb_root *root){   /// x (maybe NULL) is short one black
+   struct rb_node *w;
+
+   while (x != root->rb_node && !rb_is_red(x)) {
+      if (x == parent->rb_left) {   // x's sibling has a black node on every path, so it exists
+         w = parent->rb_right;
+         if (w->rb_red) {
+            w->rb_red = 0;
+            parent->rb_red = 1;
+            rb_rotate_left(parent, root);
+            w = parent->rb_right;
+         }
+         if (!rb_is_red(w->rb_left) && !rb_is_red(w->rb_right)) {
+            w->rb_red = 1;
+            x = parent;
+            parent = x->rb_parent;
+            continue;
+         }
+         if (!rb_is_red(w->rb_right)) {
+            w->rb_left->rb_red = 0;
+            w->rb_red = 1;
+            rb_rotate_right(w, root);
+            w = parent->rb_right;
+         }
+         w->rb_red = parent->rb_red;
+         parent->rb_red = 0;
+         w->rb_right->rb_red = 0;
+         rb_rotate_left(parent, root);
+      } else {
+         w = parent->rb_left;
+         if (w->rb_red) {
+            w->rb_red = 0;
+            parent->rb_red = 1;
+            rb_rotate_right(parent, root);
+            w = parent->rb_left;
+         }
+         if (!rb_is_red(w->rb_left) && !rb_is_red(w->rb_right)) {
+            w->rb_red = 1;
+            x = parent;
+            parent = x->rb_parent;
+            continue;
+         }
+         if (!rb_is_red(w->rb_left)) {
+            w->rb_right->rb_red = 0;
+            w->rb_red = 1;
+            rb_rotate_left(w, root);
+            w = parent->rb_left;
+         }
+         w->rb_red = parent->rb_red;
+         parent->rb_red = 0;
+         w->rb_left->rb_red = 0;
+         rb_rotate_right(parent, root);
+      }
+      x = root->rb_node;
+   }
+   if (x)
+      x->rb_red = 0;
+}
+
+void rb_erase(struct rb_node *z, struct rb_root *root){
+   struct rb_node *child, *parent, *y;
+   int red;
+
+   if (!z->rb_left || !z->rb_right) {
+      child = z->rb_left ? z->rb_left : z->rb_right;
+      parent = z->rb_parent;
+      red = z->rb_red;
+      if (child)
+         child->rb_parent = parent;
+      rb_set_child(parent, z, child, root);
+   } else {
+      y = z->rb_right;   // successor, takes z's place
+      while (y->rb_left)
+         y = y->rb_left;
+      red = y->rb_red;
+      child = y->rb_right;
+      if (y->rb_parent == z) {
+         parent = y;
+      } else {
+         parent = y->rb_parent;
+         if (child)
+            child->rb_parent = parent;
+         parent->rb_left = child;
+         y->rb_right = z->rb_right;
+         z->rb_right->rb_parent = y;
+      }
+      y->rb_parent = z->rb_parent;
+      rb_set_child(z->rb_parent, z, y, root);
+      y->rb_left = z->rb_left;
+      z->rb_left->rb_parent = y;
+      y->rb_red = z->rb_red;
+   }
+   if (!red)
+      rb_erase_fixup(child, parent, root);
+}
+
+void rb_replace_node(struct rb_node *victim, struct rb_node *n, struct rb_root *root){
+   *n = *victim;
+   if (victim->rb_left)
+      victim->rb_left->rb_parent = n;
+   if (victim->rb_right)
+      victim->rb_right->rb_parent = n;
+   rb_set_child(victim->rb_parent, victim, n, root);
+}
+
+struct rb_node *rb_first(const struct rb_root *root){
+   struct rb_node *n = root->rb_node;
+
+   while (n && n->rb_left)
+      n = n->rb_left;
+   return n;
+}
+
+struct rb_node *rb_last(const struct rb_root *root){
+   struct rb_node *n = root->rb_node;
+
+   while (n && n->rb_right)
+      n = n->rb_right;
+   return n;
+}
+
+struct rb_node *rb_next(const struct rb_node *node){
+   struct rb_node *n;
+
+   if (node->rb_right) {
+      for (n = node->rb_right; n->rb_left; n = n->rb_left)
+         ;
+      return n;
+   }
+   while (node->rb_parent && node == node->rb_parent->rb_right)
+      node = node->rb_parent;
+   return node->rb_parent;
+}
+
+struct rb_node *rb_prev(const struct rb_node *node){
+   struct rb_node *n;
+
+   if (node->rb_left) {
+      for (n = node->rb_left; n->rb_right; n = n->rb_right)
+         ;
+      return n;
+   }
+   while (node->rb_parent && node == node->rb_parent->rb_left)
+      node = node->rb_parent;
+   return node->rb_parent;
+}
+
+
+/*
+ * Module parameters
+ */
+static struct kernel_param *shim_params;
+
+void shim_param_register(struct kernel_param *kp){
+   kp->next = shim_params;
+   shim_params = kp;
+}
+
+int shim_param_set(const char *name, const char *val){
+   struct kernel_param *kp;
+
+   for (kp = shim_params; kp; kp = kp->next) {
+      if (!strcmp(kp->name, name))
+         return kp->ops->set(val, kp);
+   }
+   return -ENOENT;
+}
+
+static int param_set_uint(const char *val, const struct kernel_param *kp){
+   char *end;
+   unsigned long v = strtoul(val, &end, 0);
+
+   if (end == val || *end || v > UINT_MAX)
+      return -EINVAL;
+   *(unsigned int *)kp->arg = v;
+   return 0;
+}
+
+static int param_get_uint(char *buffer, const struct kernel_param *kp){
+   return sprintf(buffer, "%u\n", *(unsigned int *)kp->arg);
+}
+
+static int param_set_ulong(const char *val, const struct kernel_param *kp){
+   char *end;
+   unsigned long v = strtoul(val, &end, 0);
+
+   if (end == val || *end)
+      return -EINVAL;
+   *(unsigned long *)kp->arg = v;
+   return 0;
+}
+
+static int param_get_ulong(char *buffer, const struct kernel_param *kp){
+   return sprintf(buffer, "%lu\n", *(unsigned long *)kp->arg);
+}
+
+int param_set_bool(const char *val, const struct kernel_param *kp){
+   if (!val || !*val || !strcmp(val, "1") || !strcmp(val, "y") || !strcmp(val, "Y"))
+      *(bool *)kp->arg = true;
+   else if (!strcmp(val, "0") || !strcmp(val, "n") || !strcmp(val, "N"))
+      *(bool *)kp->arg = false;
+   else
+      return -EINVAL;
+   return 0;
+}
+
+int param_get_bool(char *buffer, const struct kernel_param *kp){
+   return sprintf(buffer, "%c\n", *(bool *)kp->arg ? 'Y' : 'N');
+}
+
+static int param_set_charp(const char *val, const struct kernel_param *kp){
+   char *s = strdup(val);
+
+   if (!s)
+      return -ENOMEM;
+   *(char **)kp->arg = s;   // the previous value may be a literal, so it is never freed
+   return 0;
+}
+
+static int param_get_charp(char *buffer, const struct kernel_param *kp){
+   return sprintf(buffer, "%s\n", *(char **)kp->arg);
+}
+
+const struct kernel_param_ops param_ops_uint = { param_set_uint, param_get_uint };
+const struct kernel_param_ops param_ops_ulong = { param_set_ulong, param_get_ulong };
+const struct kernel_param_ops param_ops_bool = { param_set_bool, param_get_bool };
+const struct kernel_param_ops param_ops_charp = { param_set_charp, param_get_charp };
+
+
+/*
+ * hsiphash is SipHash-1-3 on 64-bit kernels; the same here
+ */
+static inline u64 rol64(u64 w, unsigned int s){
+   return (w << s) | (w >> (64 - s));
+}
+
+#define SIPROUND                                                        \
+   do {                                                                 \
+      v0 += v1; v1 = rol64(v1, 13); v1 ^= v0; v0 = rol64(v0, 32);       \
+      v2 += v3; v3 = rol64(v3, 16); v3 ^= v2;                           \
+      v0 += v3; v3 = rol64(v3, 21); v3 ^= v0;                           \
+      v2 += v1; v1 = rol64(v1, 17); v1 ^= v2; v2 = rol64(v2, 32);       \
+   } while (0)
+
+u32 hsiphash(const void *data, size_t len, const hsiphash_key_t *key){
+   const u8 *p = data, *end = p + (len & ~7UL);
+   u64 v0 = 0x736f6d6570736575ULL ^ key->key[0];
+   u64 v1 = 0x646f72616e646f6dULL ^ key->key[1];
+   u64 v2 = 0x6c7967656e657261ULL ^ key->key[0];
+   u64 v3 = 0x7465646279746573ULL ^ key->key[1];
+   u64 b = (u64)len << 56, m;
+   unsigned int i;
+
+   for (; p != end; p += 8) {
+      memcpy(&m, p, 8);   // little endian, as on every machine this builds for
+      v3 ^= m;
+      SIPROUND;
+      v0 ^= m;
+   }
+   for (i = 0; i < (len & 7); i++)
+      b |= (u64)p[i] << (8 * i);
+   v3 ^= b;
+   SIPROUND;
+   v0 ^= b;
+   v2 ^= 0xff;
+   SIPROUND;
+   SIPROUND;
+   SIPROUND;
+   return (u32)((v0 ^ v1) ^ (v2 ^ v3));
+}
+
+u32 hsiphash_1u32(u32 a, const hsiphash_key_t *key){
+   return hsiphash(&a, sizeof(a), key);
+}
+
+static u32 shim_crc_table[256];
+static pthread_once_t shim_crc_once = PTHREAD_ONCE_INIT;
+
+static void shim_crc_init(void){
+   u32 c;
+   int i, j;
+
+   for (i = 0; i < 256; i++) {
+      for (c = i, j = 0; j < 8; j++)
+         c = (c >> 1) ^ (c & 1 ? 0xedb88320 : 0);
+      shim_crc_table[i] = c;
+   }
+}
+
+u32 crc32_le(u32 crc, const void *p, size_t len){   /// no pre- or post-inversion, like the kernel's
+   const u8 *b = p;
+
+   pthread_once(&shim_crc_once, shim_crc_init);
+   while (len--)
+      crc = (crc >> 8) ^ shim_crc_table[(crc ^ *b++) & 0xff];
+   return crc;
+}
+
+void get_random_bytes(void *buf, size_t len){
+   ssize_t n;
+
+   while (len) {
+      n = getrandom(buf, len, 0);
+      if (n < 0) {
+         if (errno == EINTR)
+            continue;
+         abort();
+      }
+      buf = (u8 *)buf + n;
+      len -= n;
+   }
+}
+
+
+/*
+ * Files
+ */
+struct fd fdget(int fd){
+   struct fd f = { NULL };
+   int flags = fcntl(fd, F_GETFL);
+
+   if (flags < 0)
+      return f;
+   f.file = shim_alloc(sizeof(*f.file), GFP_KERNEL);
+   if (!f.file)
+      return f;
+   f.file->fd = fd;
+   f.file->f_mode = (flags & O_ACCMODE) != O_WRONLY ? FMODE_READ : 0;
+   return f;
+}
+
+void fdput(struct fd f){
+   shim_free(f.file);
+}
+
+ssize_t kernel_read(struct file *file, void *buf, size_t count, loff_t *pos){
+   ssize_t n = pread(file->fd, buf, count, *pos);
+
+   if (n < 0 && errno == ESPIPE)
+      n = read(file->fd, buf, count);   // pipes ignore the position, as they do in the kernel
+   if (n < 0)
+      return -errno;
+   *pos += n;
+   return n;
+}
+
+loff_t shim_file_size(struct file *file){   /// i_size: 0 for anything but a regular file
+   struct stat st;
+
+   if (fstat(file->fd, &st) || !S_ISREG(st.st_mode))
+      return 0;
+   return st.st_size;
+}
@@ -0,0 +1,516 @@
+/**
+ * @file   ht530_shim.h
+ * @brief   Just enough of the kernel API for ht530_core.c to build and run in userspace
+ *
+ * Everything here keeps the kernel's names and semantics, implemented over pthreads, the GCC
+ * __atomic builtins and libc, so the core builds unchanged (see ht530_mock.h for the device side).
+ * The parts that are more than a rename:
+ *   - spinlocks are mutexes, since a userspace thread can be preempted while it holds one; like a
+ *     kernel spinlock (or BHs off) they still hold off RCU grace periods, which the core relies on
+ *   - RCU is a small quiescent-state-free implementation: readers announce themselves in a per-thread
+ *     record, synchronize_rcu() waits for every reader that started before it, call_rcu() callbacks
+ *     run on a reclaimer thread after a grace period
+ *   - "CPUs" are a fixed number of slots threads are spread over; per-CPU data is a strided array and
+ *     local_bh_disable() locks the calling thread's slot, which is all the entry stash relies on
+ *   - work items run on one worker thread, jiffies are milliseconds of CLOCK_MONOTONIC
+ *   - module parameters register themselves, so shim_param_set() takes what insmod would
+ * Nothing is shared with ht530_dev.c, which stays kernel-only.
+ */
+
+#ifndef HT530_SHIM_H
+#define HT530_SHIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int64_t  s64;
+typedef unsigned int gfp_t;
+
+#define __user
+#define __rcu
+#define __percpu
+#define __aligned(x)                   __attribute__((aligned(x)))
+#define ____cacheline_aligned_in_smp   __aligned(64)
+#define likely(x)                      __builtin_expect(!!(x), 1)
+#define unlikely(x)                    __builtin_expect(!!(x), 0)
+#define prefetch(x)                    __builtin_prefetch(x)
+
+#define CONFIG_64BIT   (UINTPTR_MAX == UINT64_MAX)
+#define IS_ENABLED(option)  (option)
+#define PAGE_SIZE      4096UL
+#define PAGE_ALIGN(x)  ALIGN(x, PAGE_SIZE)
+#define S32_MAX        INT32_MAX
+#define S64_MAX        INT64_MAX
+#define U32_MAX        UINT32_MAX
+#define U64_MAX        UINT64_MAX
+#define HZ             1000
+
+/*
+ * Memory model. READ_ONCE/WRITE_ONCE are relaxed atomics rather than volatile accesses, so
+ * ThreadSanitizer sees the lock-free paths for what they are.
+ */
+#define READ_ONCE(x)             __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define WRITE_ONCE(x, v)         __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#define smp_load_acquire(p)      __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define smp_store_release(p, v)  __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define smp_mb()                 __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define cpu_relax()              __asm__ __volatile__("" ::: "memory")
+#define cmpxchg(p, o, n) ({                                               \
+   __typeof__(*(p)) __old = (o);                                          \
+   __atomic_compare_exchange_n(p, &__old, n, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); \
+   __old; })
+#define cmpxchg64(p, o, n)  cmpxchg(p, o, n)
+
+typedef struct { int counter; } atomic_t;
+#define ATOMIC_INIT(i)            { (i) }
+#define atomic_read(v)            __atomic_load_n(&(v)->counter, __ATOMIC_RELAXED)
+#define atomic_set(v, i)          __atomic_store_n(&(v)->counter, (i), __ATOMIC_RELAXED)
+#define atomic_inc_return(v)      __atomic_add_fetch(&(v)->counter, 1, __ATOMIC_SEQ_CST)
+#define atomic_dec_return(v)      __atomic_sub_fetch(&(v)->counter, 1, __ATOMIC_SEQ_CST)
+#define atomic_add_return(i, v)   __atomic_add_fetch(&(v)->counter, (i), __ATOMIC_SEQ_CST)
+#define atomic_inc(v)             ((void)__atomic_add_fetch(&(v)->counter, 1, __ATOMIC_RELAXED))
+#define atomic_dec(v)             ((void)__atomic_sub_fetch(&(v)->counter, 1, __ATOMIC_RELAXED))
+
+/* Helpers from kernel.h, log2.h, math64.h, bitops.h, overflow.h */
+#define container_of(ptr, type, member)  ((type *)((char *)(ptr) - offsetof(type, member)))
+#define ARRAY_SIZE(a)          (sizeof(a) / sizeof((a)[0]))
+#define ALIGN(x, a)            (((x) + ((a) - 1)) & ~((__typeof__(x))(a) - 1))
+#define min(a, b)              ({ __typeof__(a) __a = (a); __typeof__(b) __b = (b); __a < __b ? __a : __b; })
+#define max(a, b)              ({ __typeof__(a) __a = (a); __typeof__(b) __b = (b); __a > __b ? __a : __b; })
+#define min3(a, b, c)          min(min(a, b), c)
+#define min_t(type, a, b)      min((type)(a), (type)(b))
+#define max_t(type, a, b)      max((type)(a), (type)(b))
+#define clamp_t(type, v, lo, hi)  min_t(type, max_t(type, v, lo), hi)
+#define struct_size(p, member, n)  (sizeof(*(p)) + sizeof(*(p)->member) * (size_t)(n))
+#define div_u64(a, b)          ((u64)(a) / (u32)(b))
+#define div64_u64(a, b)        ((u64)(a) / (u64)(b))
+#define __ffs64(x)             ((unsigned int)__builtin_ctzll(x))
+#define order_base_2(n)        ((n) > 1 ? 64 - __builtin_clzll((u64)(n) - 1) : 0)
+#define ilog2(n)               (63 - __builtin_clzll((u64)(n)))
+#define roundup_pow_of_two(n)  (1UL << order_base_2(n))
+#define u64_to_user_ptr(x)     ((void *)(uintptr_t)(x))
+
+#define MAX_ERRNO  4095
+#define ERR_PTR(err)    ((void *)(long)(err))
+#define PTR_ERR(ptr)    ((long)(ptr))
+#define IS_ERR(ptr)     ((unsigned long)(ptr) >= (unsigned long)-MAX_ERRNO)
+
+/* printk: warnings and worse go to stderr, the rest only with shim_verbose set */
+#define KERN_SOH      "\001"
+#define KERN_ALERT    KERN_SOH "1"
+#define KERN_ERR      KERN_SOH "3"
+#define KERN_WARNING  KERN_SOH "4"
+#define KERN_INFO     KERN_SOH "6"
+#define KERN_DEBUG    KERN_SOH "7"
+extern bool shim_verbose;
+int printk(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/* Allocation. Everything is 64-byte aligned, as kmalloc of a power of two would be. */
+#define GFP_KERNEL    0U
+#define GFP_ATOMIC    1U
+#define __GFP_NOWARN  2U
+#define __GFP_ZERO    4U
+#define __GFP_ACCOUNT 8U
+#define GFP_KERNEL_ACCOUNT  (GFP_KERNEL | __GFP_ACCOUNT)
+void *shim_alloc(size_t size, gfp_t gfp);
+void shim_free(const void *p);
+#define kmalloc(size, gfp)              shim_alloc(size, gfp)
+#define kzalloc(size, gfp)              shim_alloc(size, (gfp) | __GFP_ZERO)
+#define kvmalloc(size, gfp)             kmalloc(size, gfp)
+#define kvzalloc(size, gfp)             kzalloc(size, gfp)
+#define kvmalloc_array(n, size, gfp)    kmalloc_array(n, size, gfp)
+#define kcalloc(n, size, gfp)           kmalloc_array(n, size, (gfp) | __GFP_ZERO)
+#define kfree(p)                        shim_free(p)
+#define kvfree(p)                       shim_free(p)
+#define vmalloc_user(size)              shim_alloc(size, __GFP_ZERO)
+#define vfree(p)                        shim_free(p)
+static inline void *kmalloc_array(size_t n, size_t size, gfp_t gfp){
+   return size && n > SIZE_MAX / size ? NULL : shim_alloc(n * size, gfp);
+}
+
+struct kmem_cache {
+   size_t size, align;
+};
+struct kmem_cache *kmem_cache_create(const char *name, unsigned int size, unsigned int align,
+                                     unsigned long flags, void (*ctor)(void *));
+void kmem_cache_destroy(struct kmem_cache *s);
+void *kmem_cache_alloc(struct kmem_cache *s, gfp_t gfp);
+void kmem_cache_free(struct kmem_cache *s, void *p);
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t gfp, size_t nr, void **p);
+void kmem_cache_free_bulk(struct kmem_cache *s, size_t nr, void **p);
+#define SLAB_ACCOUNT  0x04000000UL
+
+/* Memory cgroups don't exist here: nothing is charged. shim_reclaim() runs the shrinkers. */
+struct mem_cgroup;
+#define get_mem_cgroup_from_mm(mm)  ((struct mem_cgroup *)NULL)
+#define mem_cgroup_put(memcg)       ((void)(memcg))
+#define memalloc_use_memcg(memcg)   ((void)(memcg))
+#define memalloc_unuse_memcg()      do { } while (0)
+
+struct shrink_control {
+   gfp_t gfp_mask;
+   unsigned long nr_to_scan;
+};
+struct shrinker {
+   unsigned long (*count_objects)(struct shrinker *s, struct shrink_control *sc);
+   unsigned long (*scan_objects)(struct shrinker *s, struct shrink_control *sc);
+   int seeks;
+   struct shrinker *next;
+};
+#define DEFAULT_SEEKS  2
+#define SHRINK_STOP    (~0UL)
+#define SHRINK_EMPTY   (~0UL - 1)
+int register_shrinker(struct shrinker *s);
+void unregister_shrinker(struct shrinker *s);
+unsigned long shim_reclaim(unsigned long nr);   /// what memory pressure asking for nr objects would do, returns objects freed
+
+/* Per-CPU data: SHIM_NR_CPUS copies SHIM_PCPU_STRIDE bytes apart, a thread always uses the same one */
+#define SHIM_NR_CPUS      16
+#define SHIM_PCPU_STRIDE  4096
+extern __thread int shim_cpu;
+int shim_cpu_slow(void);
+static inline int shim_this_cpu(void){
+   return shim_cpu >= 0 ? shim_cpu : shim_cpu_slow();
+}
+void *shim_alloc_percpu(size_t size);
+#define alloc_percpu(type)         ((type *)shim_alloc_percpu(sizeof(type)))
+#define free_percpu(p)             shim_free(p)
+#define per_cpu_ptr(p, cpu)        ((__typeof__(p))((char *)(p) + (size_t)(cpu) * SHIM_PCPU_STRIDE))
+#define this_cpu_ptr(p)            per_cpu_ptr(p, shim_this_cpu())
+#define this_cpu_inc(var)          ((void)__atomic_add_fetch(this_cpu_ptr(&(var)), 1, __ATOMIC_RELAXED))
+#define this_cpu_inc_return(var)   __atomic_add_fetch(this_cpu_ptr(&(var)), 1, __ATOMIC_RELAXED)
+#define num_possible_cpus()        SHIM_NR_CPUS
+#define for_each_possible_cpu(cpu) for ((cpu) = 0; (cpu) < SHIM_NR_CPUS; (cpu)++)
+void local_bh_disable(void);
+void local_bh_enable(void);
+
+struct percpu_counter {
+   s64 count;
+};
+#define percpu_counter_init(fbc, v, gfp)    (__atomic_store_n(&(fbc)->count, (v), __ATOMIC_RELAXED), 0)
+#define percpu_counter_destroy(fbc)         ((void)(fbc))
+#define percpu_counter_add(fbc, v)          ((void)__atomic_add_fetch(&(fbc)->count, (v), __ATOMIC_RELAXED))
+#define percpu_counter_sub(fbc, v)          percpu_counter_add(fbc, -(s64)(v))
+#define percpu_counter_inc(fbc)             percpu_counter_add(fbc, 1)
+#define percpu_counter_dec(fbc)             percpu_counter_add(fbc, -1)
+#define percpu_counter_read(fbc)            __atomic_load_n(&(fbc)->count, __ATOMIC_RELAXED)
+#define percpu_counter_read_positive(fbc)   max_t(s64, percpu_counter_read(fbc), 0)
+#define percpu_counter_sum_positive(fbc)    percpu_counter_read_positive(fbc)
+#define percpu_counter_compare(fbc, rhs)    ((percpu_counter_read(fbc) > (s64)(rhs)) - (percpu_counter_read(fbc) < (s64)(rhs)))
+
+/* Locks */
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+
+typedef pthread_mutex_t spinlock_t;
+#define SINGLE_DEPTH_NESTING            1
+#define spin_lock_init(l)               pthread_mutex_init(l, NULL)
+#define spin_lock_nested(l, subclass)   spin_lock(l)
+static inline void spin_lock(spinlock_t *l){
+   rcu_read_lock();
+   pthread_mutex_lock(l);
+}
+static inline bool spin_trylock(spinlock_t *l){
+   rcu_read_lock();
+   if (!pthread_mutex_trylock(l))
+      return true;
+   rcu_read_unlock();
+   return false;
+}
+static inline void spin_unlock(spinlock_t *l){
+   pthread_mutex_unlock(l);
+   rcu_read_unlock();
+}
+
+struct mutex {
+   pthread_mutex_t m;
+};
+#define DEFINE_MUTEX(name)              struct mutex name = { PTHREAD_MUTEX_INITIALIZER }
+#define mutex_init(l)                   pthread_mutex_init(&(l)->m, NULL)
+#define mutex_destroy(l)                pthread_mutex_destroy(&(l)->m)
+#define mutex_lock(l)                   pthread_mutex_lock(&(l)->m)
+#define mutex_lock_interruptible(l)     pthread_mutex_lock(&(l)->m)
+#define mutex_unlock(l)                 pthread_mutex_unlock(&(l)->m)
+#define lockdep_is_held(l)              1
+
+struct percpu_rw_semaphore {
+   pthread_rwlock_t rw;
+};
+int percpu_init_rwsem(struct percpu_rw_semaphore *sem);   /// writer-preferring, as the kernel's is
+#define percpu_free_rwsem(sem)          pthread_rwlock_destroy(&(sem)->rw)
+#define percpu_down_read(sem)           pthread_rwlock_rdlock(&(sem)->rw)
+#define percpu_up_read(sem)             pthread_rwlock_unlock(&(sem)->rw)
+#define percpu_down_write(sem)          pthread_rwlock_wrlock(&(sem)->rw)
+#define percpu_up_write(sem)            pthread_rwlock_unlock(&(sem)->rw)
+
+struct kref {
+   atomic_t refcount;
+};
+#define kref_init(k)    atomic_set(&(k)->refcount, 1)
+#define kref_get(k)     ((void)atomic_inc_return(&(k)->refcount))
+static inline int kref_put(struct kref *k, void (*release)(struct kref *)){
+   if (atomic_dec_return(&k->refcount))
+      return 0;
+   release(k);
+   return 1;
+}
+
+typedef struct {
+   pthread_mutex_t lock;
+   pthread_cond_t cond;
+} wait_queue_head_t;
+void init_waitqueue_head(wait_queue_head_t *wq);
+void wake_up_interruptible(wait_queue_head_t *wq);
+
+#define cond_resched()   do { } while (0)
+#define might_sleep()    do { } while (0)
+
+/* Time */
+unsigned long shim_jiffies(void);
+#define jiffies                   shim_jiffies()
+#define msecs_to_jiffies(m)       ((unsigned long)(m))
+#define time_after(a, b)          ((long)((b) - (a)) < 0)
+#define time_after_eq(a, b)       ((long)((a) - (b)) >= 0)
+#define time_before(a, b)         time_after(b, a)
+u64 ktime_get_ns(void);
+
+/* Lists */
+struct list_head {
+   struct list_head *next, *prev;
+};
+#define LIST_HEAD(name)  struct list_head name = { &(name), &(name) }
+static inline void INIT_LIST_HEAD(struct list_head *l){
+   l->next = l->prev = l;
+}
+static inline void list_add(struct list_head *n, struct list_head *head){
+   n->next = head->next;
+   n->prev = head;
+   head->next->prev = n;
+   head->next = n;
+}
+static inline void list_add_tail(struct list_head *n, struct list_head *head){
+   list_add(n, head->prev);
+}
+static inline void list_del(struct list_head *e){
+   e->next->prev = e->prev;
+   e->prev->next = e->next;
+   e->next = e->prev = NULL;
+}
+static inline void list_move_tail(struct list_head *e, struct list_head *head){
+   list_del(e);
+   list_add_tail(e, head);
+}
+#define list_empty(head)             (READ_ONCE((head)->next) == (head))
+#define list_entry(ptr, type, member)  container_of(ptr, type, member)
+#define list_for_each_entry(pos, head, member)                                  \
+   for (pos = list_entry((head)->next, __typeof__(*pos), member);               \
+        &pos->member != (head);                                                 \
+        pos = list_entry(pos->member.next, __typeof__(*pos), member))
+
+struct hlist_head {
+   struct hlist_node *first;
+};
+struct hlist_node {
+   struct hlist_node *next, **pprev;
+};
+#define HLIST_HEAD(name)  struct hlist_head name = { NULL }
+#define INIT_HLIST_HEAD(h)  ((h)->first = NULL)
+#define hlist_entry(ptr, type, member)  container_of(ptr, type, member)
+#define hlist_entry_safe(ptr, type, member) \
+   ({ __typeof__(ptr) ____ptr = (ptr); ____ptr ? hlist_entry(____ptr, type, member) : NULL; })
+static inline void hlist_add_head(struct hlist_node *n, struct hlist_head *h){
+   n->next = h->first;
+   if (h->first)
+      h->first->pprev = &n->next;
+   h->first = n;
+   n->pprev = &h->first;
+}
+#define hlist_for_each_entry_safe(pos, n, head, member)                         \
+   for (pos = hlist_entry_safe((head)->first, __typeof__(*pos), member);        \
+        pos && ({ n = pos->member.next; 1; });                                  \
+        pos = hlist_entry_safe(n, __typeof__(*pos), member))
+
+/* RCU */
+struct rcu_head {
+   struct rcu_head *next;
+   void (*func)(struct rcu_head *head);
+};
+void synchronize_rcu(void);
+void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *head));
+void rcu_barrier(void);
+#define rcu_dereference(p)               __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define rcu_dereference_raw(p)           rcu_dereference(p)
+#define rcu_dereference_protected(p, c)  READ_ONCE(p)
+#define rcu_access_pointer(p)            READ_ONCE(p)
+#define rcu_assign_pointer(p, v)         __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#define RCU_INIT_POINTER(p, v)           WRITE_ONCE(p, v)
+
+#define hlist_first_rcu(head)  ((head)->first)
+#define hlist_next_rcu(node)   ((node)->next)
+static inline void hlist_add_head_rcu(struct hlist_node *n, struct hlist_head *h){
+   struct hlist_node *first = h->first;
+
+   n->next = first;
+   n->pprev = &h->first;
+   rcu_assign_pointer(h->first, n);
+   if (first)
+      first->pprev = &n->next;
+}
+static inline void hlist_del_rcu(struct hlist_node *n){
+   struct hlist_node *next = n->next;
+
+   WRITE_ONCE(*n->pprev, next);
+   if (next)
+      next->pprev = n->pprev;
+   n->pprev = NULL;
+}
+static inline void hlist_replace_rcu(struct hlist_node *old, struct hlist_node *n){
+   struct hlist_node *next = old->next;
+
+   n->next = next;
+   n->pprev = old->pprev;
+   rcu_assign_pointer(*n->pprev, n);
+   if (next)
+      next->pprev = &n->next;
+   old->pprev = NULL;
+}
+
+/* Red-black tree, the rbtree.h interface over a plain parent-pointer implementation */
+struct rb_node {
+   struct rb_node *rb_parent;
+   struct rb_node *rb_right;
+   struct rb_node *rb_left;
+   int rb_red;
+};
+struct rb_root {
+   struct rb_node *rb_node;
+};
+#define RB_ROOT                       (struct rb_root) { NULL }
+#define rb_entry(ptr, type, member)   container_of(ptr, type, member)
+static inline void rb_link_node(struct rb_node *node, struct rb_node *parent, struct rb_node **link){
+   node->rb_parent = parent;
+   node->rb_left = node->rb_right = NULL;
+   node->rb_red = 1;
+   *link = node;
+}
+void rb_insert_color(struct rb_node *node, struct rb_root *root);
+void rb_erase(struct rb_node *node, struct rb_root *root);
+void rb_replace_node(struct rb_node *victim, struct rb_node *n, struct rb_root *root);
+struct rb_node *rb_first(const struct rb_root *root);
+struct rb_node *rb_last(const struct rb_root *root);
+struct rb_node *rb_next(const struct rb_node *node);
+struct rb_node *rb_prev(const struct rb_node *node);
+
+/* Work items, all run by one worker thread */
+struct work_struct {
+   void (*func)(struct work_struct *work);
+   struct work_struct *next;     // on the worker's queue
+   unsigned long when;           // jiffies it is due
+   bool pending;
+};
+struct delayed_work {
+   struct work_struct work;
+};
+#define INIT_WORK(w, f)           do { memset(w, 0, sizeof(*(w))); (w)->func = (f); } while (0)
+#define INIT_DELAYED_WORK(w, f)   INIT_WORK(&(w)->work, f)
+#define to_delayed_work(w)        container_of(w, struct delayed_work, work)
+bool shim_queue_work(struct work_struct *work, unsigned long delay);
+bool shim_cancel_work_sync(struct work_struct *work);
+bool shim_flush_work(struct work_struct *work);
+#define schedule_work(w)                 shim_queue_work(w, 0)
+#define schedule_delayed_work(w, delay)  shim_queue_work(&(w)->work, delay)
+#define cancel_work_sync(w)              shim_cancel_work_sync(w)
+#define flush_work(w)                    shim_flush_work(w)
+#define cancel_delayed_work_sync(w)      shim_cancel_work_sync(&(w)->work)
+
+/* Static keys are plain flags */
+struct static_key_false {
+   int enabled;
+};
+#define DEFINE_STATIC_KEY_FALSE(name)   struct static_key_false name = { 0 }
+#define DECLARE_STATIC_KEY_FALSE(name)  extern struct static_key_false name
+#define static_branch_unlikely(k)       unlikely(__atomic_load_n(&(k)->enabled, __ATOMIC_RELAXED))
+#define static_branch_enable(k)         __atomic_store_n(&(k)->enabled, 1, __ATOMIC_RELAXED)
+#define static_branch_disable(k)        __atomic_store_n(&(k)->enabled, 0, __ATOMIC_RELAXED)
+
+/* Module parameters register themselves at startup; shim_param_set() sets one by name */
+struct kernel_param;
+struct kernel_param_ops {
+   int (*set)(const char *val, const struct kernel_param *kp);
+   int (*get)(char *buffer, const struct kernel_param *kp);
+};
+struct kernel_param {
+   const char *name;
+   const struct kernel_param_ops *ops;
+   void *arg;
+   struct kernel_param *next;
+};
+extern const struct kernel_param_ops param_ops_uint, param_ops_ulong, param_ops_bool, param_ops_charp;
+int param_set_bool(const char *val, const struct kernel_param *kp);
+int param_get_bool(char *buffer, const struct kernel_param *kp);
+void shim_param_register(struct kernel_param *kp);
+int shim_param_set(const char *name, const char *val);
+#define module_param_cb(name, ops_, arg_, perm)                                 \
+   static struct kernel_param __shim_param_##name = { #name, ops_, arg_, NULL }; \
+   __attribute__((constructor)) static void __shim_param_add_##name(void){     \
+      shim_param_register(&__shim_param_##name);                                \
+   }
+#define module_param(name, type, perm)  module_param_cb(name, &param_ops_##type, &name, perm)
+#define MODULE_PARM_DESC(name, desc)    struct __shim_param_desc_##name
+
+/* The rest: hashing, checksums, randomness and user copies */
+typedef struct {
+   u64 key[2];
+} hsiphash_key_t;
+u32 hsiphash(const void *data, size_t len, const hsiphash_key_t *key);
+u32 hsiphash_1u32(u32 a, const hsiphash_key_t *key);
+u32 crc32_le(u32 crc, const void *p, size_t len);
+void get_random_bytes(void *buf, size_t len);
+
+/* Files: a struct file stands for a descriptor of this process */
+typedef unsigned int fmode_t;
+#define FMODE_READ  1U
+struct file {
+   int fd;
+   fmode_t f_mode;
+};
+struct fd {
+   struct file *file;
+};
+struct fd fdget(int fd);
+void fdput(struct fd f);
+ssize_t kernel_read(struct file *file, void *buf, size_t count, loff_t *pos);
+loff_t shim_file_size(struct file *file);
+#define file_inode(file)    (file)
+#define i_size_read(inode)  shim_file_size(inode)
+
+#define copy_from_user(to, from, n)  (memcpy(to, from, n), 0UL)
+#define copy_to_user(to, from, n)    (memcpy(to, from, n), 0UL)
+#define put_user(x, p)               (*(p) = (x), 0)
+#define get_user(x, p)               ((x) = *(p), 0)
+
+/* ht530_trace.h: the tracepoints compile away, their arguments are still evaluated */
+static inline void shim_trace(int unused, ...){
+   (void)unused;
+}
+#define trace_ht530_insert(...)   shim_trace(0, __VA_ARGS__)
+#define trace_ht530_replace(...)  shim_trace(0, __VA_ARGS__)
+#define trace_ht530_delete(...)   shim_trace(0, __VA_ARGS__)
+#define trace_ht530_evict(...)    shim_trace(0, __VA_ARGS__)
+#define trace_ht530_expire(...)   shim_trace(0, __VA_ARGS__)
+#define trace_ht530_hit(...)      shim_trace(0, __VA_ARGS__)
+#define trace_ht530_miss(...)     shim_trace(0, __VA_ARGS__)
+#define trace_ht530_dump(...)     shim_trace(0, __VA_ARGS__)
+
+#endif
@@ -0,0 +1,113 @@
+/**
+ * @file   ht530_trace.h
+ * @brief   Tracepoints for ht530 table operations
+ *
+ * Every event carries the table id (the device minor) and the key bytes; 4-byte int keys show up
+ * as their in-memory (little-endian on x86) bytes. Enable with e.g.
+ *    echo 1 > /sys/kernel/debug/tracing/events/ht530/enable
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM ht530
+
+#if !defined(_HT530_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _HT530_TRACE_H
+
+#include <linux/tracepoint.h>
+
+DECLARE_EVENT_CLASS(ht530_kv,
+   TP_PROTO(unsigned int table, const void *key, unsigned int klen, unsigned int vlen),
+   TP_ARGS(table, key, klen, vlen),
+   TP_STRUCT__entry(
+      __field(unsigned int, table)
+      __field(unsigned int, vlen)
+      __dynamic_array(u8, key, klen)
+   ),
+   TP_fast_assign(
+      __entry->table = table;
+      __entry->vlen = vlen;
+      memcpy(__get_dynamic_array(key), key, klen);
+   ),
+   TP_printk("table=%u key=%s vlen=%u", __entry->table,
+             __print_hex(__get_dynamic_array(key), __get_dynamic_array_len(key)), __entry->vlen)
+);
+
+/// a new key was added
+DEFINE_EVENT(ht530_kv, ht530_insert,
+   TP_PROTO(unsigned int table, const void *key, unsigned int klen, unsigned int vlen),
+   TP_ARGS(table, key, klen, vlen)
+);
+
+/// an existing key got a new value
+DEFINE_EVENT(ht530_kv, ht530_replace,
+   TP_PROTO(unsigned int table, const void *key, unsigned int klen, unsigned int vlen),
+   TP_ARGS(table, key, klen, vlen)
+);
+
+/// a key was removed; vlen is the size of the value it had
+DEFINE_EVENT(ht530_kv, ht530_delete,
+   TP_PROTO(unsigned int table, const void *key, unsigned int klen, unsigned int vlen),
+   TP_ARGS(table, key, klen, vlen)
+);
+
+/// the CLOCK hand dropped an entry to keep the table within its budget
+DEFINE_EVENT(ht530_kv, ht530_evict,
+   TP_PROTO(unsigned int table, const void *key, unsigned int klen, unsigned int vlen),
+   TP_ARGS(table, key, klen, vlen)
+);
+
+/// an entry past its TTL was freed
+DEFINE_EVENT(ht530_kv, ht530_expire,
+   TP_PROTO(unsigned int table, const void *key, unsigned int klen, unsigned int vlen),
+   TP_ARGS(table, key, klen, vlen)
+);
+
+/// a lookup found its key
+DEFINE_EVENT(ht530_kv, ht530_hit,
+   TP_PROTO(unsigned int table, const void *key, unsigned int klen, unsigned int vlen),
+   TP_ARGS(table, key, klen, vlen)
+);
+
+/// a lookup didn't find its key
+TRACE_EVENT(ht530_miss,
+   TP_PROTO(unsigned int table, const void *key, unsigned int klen),
+   TP_ARGS(table, key, klen),
+   TP_STRUCT__entry(
+      __field(unsigned int, table)
+      __dynamic_array(u8, key, klen)
+   ),
+   TP_fast_assign(
+      __entry->table = table;
+      memcpy(__get_dynamic_array(key), key, klen);
+   ),
+   TP_printk("table=%u key=%s", __entry->table,
+             __print_hex(__get_dynamic_array(key), __get_dynamic_array_len(key)))
+);
+
+/// an int entry was drained out of the table by DUMP or HT530_EXPORT_DRAIN
+TRACE_EVENT(ht530_dump,
+   TP_PROTO(unsigned int table, unsigned int bkt, int key, int data),
+   TP_ARGS(table, bkt, key, data),
+   TP_STRUCT__entry(
+      __field(unsigned int, table)
+      __field(unsigned int, bkt)
+      __field(int, key)
+      __field(int, data)
+   ),
+   TP_fast_assign(
+      __entry->table = table;
+      __entry->bkt = bkt;
+      __entry->key = key;
+      __entry->data = data;
+   ),
+   TP_printk("table=%u bucket=%u key=%d data=%d", __entry->table, __entry->bkt, __entry->key, __entry->data)
+);
+
+#endif /* _HT530_TRACE_H */
+
+/* This part must be outside the include guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE ht530_trace
+#include <trace/define_trace.h>
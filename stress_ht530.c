@@ -0,0 +1,281 @@
+/**
+ * @file   stress_ht530.c
+ * @brief   Multi-threaded consistency test for /dev/ht530
+ *
+ * Every thread owns its own range of keys and keeps what the table should hold for them, so any
+ * read() that disagrees is a bug, not a race between threads. The threads go through three phases
+ * together: fill (mostly puts, the table grows), churn (an even mix) and drain (mostly deletes, it
+ * shrinks again). Started from few buckets (init_bits), each phase resizes the table under the
+ * others' feet. At the end every key is read back once more. Exits 1 on any mismatch.
+ *
+ * Cache tables may drop entries under memory pressure, so with -c a key that went missing counts as
+ * reclaimed instead; a wrong value is still a mismatch. stress_user -r N runs N threads that play
+ * the memory pressure through ht530_mock_reclaim() meanwhile, and fails if they never freed anything.
+ *
+ *    ./stress -t 8 -k 20000           the module loaded with e.g. init_bits=4
+ *    make user SAN=thread; ./stress_user
+ *    ./stress_user -r 2               cache tables (-c, cache=1) with the shrinker running alongside
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "ht530_ioctl.h"   /// struct ht
+#ifdef HT530_MOCK
+#include "ht530_mock.h"   /// run against the in-process tables of libht530.a instead of the module
+#endif
+
+#define DEVICE_PATH "/dev/ht530"
+#define max_reports 10   /// mismatches printed per thread, the rest are only counted
+
+enum { PHASE_FILL, PHASE_CHURN, PHASE_DRAIN, NR_PHASES };
+static const char *phase_names[NR_PHASES] = { "fill", "churn", "drain" };
+static const unsigned int phase_put[NR_PHASES] = { 70, 40, 10 };   /// % of the ops that are puts
+static const unsigned int phase_del[NR_PHASES] = { 10, 40, 70 };   /// % that are deletes, the rest gets
+
+struct config {
+   const char *path;
+   unsigned int threads;
+   unsigned int keys;     // per thread
+   unsigned long ops;     // per thread and phase
+   uint64_t seed;
+   int cache;             // entries may vanish (cache tables)
+   unsigned int reclaimers;
+};
+
+struct worker {
+   pthread_t tid;
+   unsigned int id;
+   const struct config *cfg;
+   int fd;
+   int *expect;           // value each of this thread's keys should have, 0 = absent
+   uint64_t rng;
+   unsigned long ops, mismatches, errors, reclaimed;
+};
+
+static pthread_barrier_t phase_barrier;
+static atomic_int stop;
+
+static uint64_t rng_next(uint64_t *s){   /// xorshift64*
+   uint64_t x = *s;
+
+   x ^= x >> 12;
+   x ^= x << 25;
+   x ^= x >> 27;
+   *s = x;
+   return x * 0x2545F4914F6CDD1DULL;
+}
+
+static void mismatch(struct worker *w, const char *what, int key, int want, int got){
+   if (w->mismatches++ < max_reports)
+      fprintf(stderr, "thread %u: %s key %d: expected %d, got %d\n", w->id, what, key, want, got);
+}
+
+static void check_key(struct worker *w, const char *what, unsigned int i){   /// read() key i back
+   struct ht h;
+   int key = w->id * w->cfg->keys + i;
+   ssize_t ret;
+
+   h.key = key;
+   h.data = 0;
+   ret = read(w->fd, &h, sizeof(h));
+   if (ret < 0) {
+      w->errors++;
+      return;
+   }
+   if (ret == EINVAL) {   // not found
+      if (w->expect[i] && w->cfg->cache) {
+         w->reclaimed++;
+         w->expect[i] = 0;   // dropped by the shrinker, and stays dropped
+      } else if (w->expect[i]) {
+         mismatch(w, what, key, w->expect[i], 0);
+      }
+   } else if (h.key != key || h.data != w->expect[i]) {
+      mismatch(w, what, key, w->expect[i], h.data);
+   }
+}
+
+static void *worker_run(void *arg){
+   struct worker *w = arg;
+   const struct config *c = w->cfg;
+   unsigned long n;
+   unsigned int phase, i, r;
+   struct ht h;
+
+   for (phase = 0; phase < NR_PHASES; phase++) {
+      pthread_barrier_wait(&phase_barrier);   // the phases overlap only at their edges
+      for (n = 0; n < c->ops; n++) {
+         i = rng_next(&w->rng) % c->keys;
+         r = rng_next(&w->rng) % 100;
+         h.key = w->id * c->keys + i;
+         if (r < phase_put[phase]) {
+            h.data = (int)(rng_next(&w->rng) & 0x7fffffff) | 1;   // write() deletes on 0
+            if (write(w->fd, &h, sizeof(h)) < 0)
+               w->errors++;
+            else
+               w->expect[i] = h.data;
+         } else if (r < phase_put[phase] + phase_del[phase]) {
+            h.data = 0;
+            if (write(w->fd, &h, sizeof(h)) < 0)
+               w->errors++;
+            else
+               w->expect[i] = 0;
+         } else {
+            check_key(w, phase_names[phase], i);
+         }
+         w->ops++;
+      }
+   }
+   pthread_barrier_wait(&phase_barrier);
+   for (i = 0; i < c->keys; i++)   // everyone has stopped writing: the table must match exactly
+      check_key(w, "final", i);
+   return NULL;
+}
+
+#ifdef HT530_MOCK
+static void *reclaim_run(void *arg){   /// memory pressure until the workers are done
+   unsigned long *freed = arg;
+
+   while (!atomic_load_explicit(&stop, memory_order_relaxed))
+      *freed += ht530_mock_reclaim(256);
+   return NULL;
+}
+#endif
+
+static void usage(const char *prog){
+   fprintf(stderr,
+      "usage: %s [options]\n"
+      "  -p PATH     device (default " DEVICE_PATH ")\n"
+      "  -t N        threads (default 4)\n"
+      "  -k N        keys per thread (default 20000)\n"
+      "  -n N        ops per thread and phase (default 200000)\n"
+      "  -s SEED     random seed (default 1)\n"
+      "  -c          cache tables: keys may go missing, only wrong values are mismatches\n"
+#ifdef HT530_MOCK
+      "  -r N        N threads running the shrinkers meanwhile, implies -c and cache=1\n"
+#endif
+      , prog);
+}
+
+int main(int argc, char **argv){
+   struct config c = { .path = DEVICE_PATH, .threads = 4, .keys = 20000, .ops = 200000, .seed = 1 };
+   unsigned long ops = 0, mismatches = 0, errors = 0, reclaimed = 0, freed = 0;
+   unsigned long *rfreed = NULL;
+   pthread_t *rs = NULL;
+   struct worker *ws;
+   unsigned int i;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "p:t:k:n:s:cr:h")) != -1) {
+      switch (opt) {
+      case 'p': c.path = optarg; break;
+      case 't': c.threads = strtoul(optarg, NULL, 0); break;
+      case 'k': c.keys = strtoul(optarg, NULL, 0); break;
+      case 'n': c.ops = strtoul(optarg, NULL, 0); break;
+      case 's': c.seed = strtoull(optarg, NULL, 0); break;
+      case 'c': c.cache = 1; break;
+#ifdef HT530_MOCK
+      case 'r': c.reclaimers = strtoul(optarg, NULL, 0); c.cache = 1; break;
+#endif
+      default:
+         usage(argv[0]);
+         return opt == 'h' ? 0 : 1;
+      }
+   }
+   if (!c.threads || !c.keys || (uint64_t)c.threads * c.keys > (1ULL << 31)) {
+      usage(argv[0]);
+      return 1;
+   }
+#ifdef HT530_MOCK
+   // start small so that every phase resizes, unless told otherwise
+   setenv("HT530_PARAMS", c.reclaimers ? "init_bits=4 cache=1" : "init_bits=4", 0);
+#endif
+
+   ws = calloc(c.threads, sizeof(*ws));
+   if (!ws || pthread_barrier_init(&phase_barrier, NULL, c.threads)) {
+      perror("calloc");
+      return 1;
+   }
+   for (i = 0; i < c.threads; i++) {
+      ws[i].id = i;
+      ws[i].cfg = &c;
+      ws[i].rng = (c.seed + i) * 0x9E3779B97F4A7C15ULL | 1;
+      ws[i].expect = calloc(c.keys, sizeof(int));
+      if (!ws[i].expect) {
+         perror("calloc");
+         return 1;
+      }
+      ws[i].fd = open(c.path, O_RDWR);
+      if (ws[i].fd < 0) {
+         perror("Failed to open the device");
+         return 1;
+      }
+   }
+   for (i = 0; i < c.threads; i++) {   // keys are the thread's own, what an earlier run left is gone
+      struct ht h = { .data = 0 };
+      unsigned int k;
+
+      for (k = 0; k < c.keys; k++) {
+         h.key = i * c.keys + k;
+         if (write(ws[i].fd, &h, sizeof(h)) < 0) {
+            perror("Failed to write the message to the device");
+            return 1;
+         }
+      }
+   }
+   for (i = 0; i < c.threads; i++) {
+      if (pthread_create(&ws[i].tid, NULL, worker_run, &ws[i])) {
+         perror("pthread_create");
+         return 1;
+      }
+   }
+#ifdef HT530_MOCK
+   rs = calloc(c.reclaimers, sizeof(*rs));
+   rfreed = calloc(c.reclaimers, sizeof(*rfreed));
+   if (c.reclaimers && (!rs || !rfreed)) {
+      perror("calloc");
+      return 1;
+   }
+   for (i = 0; i < c.reclaimers; i++) {
+      if (pthread_create(&rs[i], NULL, reclaim_run, &rfreed[i])) {
+         perror("pthread_create");
+         return 1;
+      }
+   }
+#endif
+
+   for (i = 0; i < c.threads; i++) {
+      pthread_join(ws[i].tid, NULL);
+      ops += ws[i].ops;
+      mismatches += ws[i].mismatches;
+      errors += ws[i].errors;
+      reclaimed += ws[i].reclaimed;
+      close(ws[i].fd);
+      free(ws[i].expect);
+   }
+   atomic_store_explicit(&stop, 1, memory_order_relaxed);
+   for (i = 0; i < c.reclaimers; i++) {
+      pthread_join(rs[i], NULL);
+      freed += rfreed[i];
+   }
+   free(rs);
+   free(rfreed);
+   free(ws);
+   pthread_barrier_destroy(&phase_barrier);
+
+   printf("%u threads x %u keys, %lu ops: %lu mismatches, %lu errors\n", c.threads, c.keys, ops, mismatches, errors);
+   if (c.cache)
+      printf("%lu keys found reclaimed", reclaimed);
+   if (c.reclaimers)
+      printf(", %lu entries freed by the shrinkers", freed);
+   if (c.cache)
+      printf("\n");
+   return mismatches || errors || (c.reclaimers && !freed);
+}
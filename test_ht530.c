@@ -21,9 +21,11 @@
 #include <signal.h>
 #include <setjmp.h>
 #include <pthread.h> 
+#ifdef HT530_MOCK
+#include "ht530_mock.h"   /// run against the in-process tables of libht530.a instead of the module
+#endif
 
 #define BUFFER_LENGTH 256               ///< The buffer length (crude but fine)
-static char receive[BUFFER_LENGTH];     ///< The receive buffer from the LKM
  
 #define DUMP _IOWR('d','d',int32_t*)
 
@@ -102,14 +104,13 @@ for(int i=0;i<200;i++){
       perror("EINVAL Invalid Argument.");
    } else {
 
-      struct ht* dmp8 = (struct ht*) &iomsg;
       for(int i=0;i<8;i++){
          printf("key=[%d] data=[%d]\n",d.object_array[i].key, d.object_array[i].data);
       }
    }
 
 }
-
+   return NULL;
 }
 
 
@@ -122,7 +123,6 @@ int main(){
   
 
 
-   int ret;
    int fd=0;
    printf("Starting ht530 device test code example...\n");
    fd = open("/dev/ht530", O_RDWR); // Open the device with read/write access